@@ -27,6 +27,7 @@
 extern "C" {
 #endif
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -37,6 +38,47 @@ extern int bitcmp(const void *bits1, size_t pos1,
     const void *bits2, size_t pos2, size_t size);
 extern bool biteq(const void *bits1, size_t pos1,
     const void *bits2, size_t pos2, size_t size);
+extern size_t bitmismatch(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size);
+extern size_t bitfind(const void *bits, size_t pos, size_t size,
+    const void *needle, size_t npos, size_t nsize);
+extern size_t bitfindapprox(const void *bits, size_t pos, size_t size,
+    const void *needle, size_t npos, size_t nsize, size_t maxerrors);
+
+typedef struct bitfinder bitfinder;
+
+typedef struct bitfinditer {
+  const bitfinder *finder;
+  const void *bits;
+  size_t pos;
+  size_t size;
+  size_t at;
+  uint32_t state;
+  uint32_t out;
+  uint32_t id;
+} bitfinditer;
+
+extern bitfinder *bitfindermake(const void *const *needles,
+    const size_t *npos, const size_t *nsizes, size_t count);
+extern void bitfinderfree(bitfinder *f);
+extern bitfinditer bitfindbegin(const bitfinder *f,
+    const void *bits, size_t pos, size_t size);
+extern bool bitfindnext(bitfinditer *it, size_t *id, size_t *offset);
+
+typedef struct bitpattern bitpattern;
+
+extern bitpattern *bitpatternmake(const char *text);
+extern void bitpatternfree(bitpattern *p);
+extern size_t bitpatternsize(const bitpattern *p);
+extern bool bitmatch(const void *bits, size_t pos, const bitpattern *p);
+extern size_t bitmatchscan(const void *bits, size_t pos, size_t size,
+    const bitpattern *p);
+
+#define BITRANDLANES 4
+
+typedef struct bitrandstate {
+  uint64_t s[4][BITRANDLANES];
+} bitrandstate;
 
 extern bool bitget(const void *bits, size_t pos);
 extern void bitset(void *bits, size_t pos, bool value);
@@ -46,9 +88,14 @@ extern void bitsetf(void *bits, size_t pos, size_t size,
 extern void bitvsetf(void *bits, size_t pos, size_t size,
     const char *format, va_list ap);
 extern void bitclear(void *bits, size_t pos, size_t size);
+extern void bitfill(void *bits, size_t pos, size_t size,
+    uint64_t pattern, size_t patternbits);
 extern void bitrand(void *bits, size_t pos, size_t size,
     size_t randsize, void (*rand)(void *buf));
 extern void bitstdrand(void *bits, size_t pos, size_t size);
+extern void bitrandseed(bitrandstate *state, uint64_t seed, uint64_t stream);
+extern void bitrandfill(bitrandstate *state,
+    void *bits, size_t pos, size_t size);
 
 extern void bitlshift(void *dest, size_t destpos,
     const void *src, size_t srcpos, size_t size, size_t shift);
@@ -59,6 +106,8 @@ extern void bitlrotate(void *dest, size_t destpos,
 extern void bitrrotate(void *dest, size_t destpos,
     const void *src, size_t srcpos, size_t size, size_t shift);
 
+/* bitand, bitor and bitxor are operator names in C++ */
+#ifndef __cplusplus
 extern void bitand(void *dest, size_t destpos,
    const void *bits1, size_t pos1,
    const void *bits2, size_t pos2, size_t size);
@@ -68,8 +117,56 @@ extern void bitor(void *dest, size_t destpos,
 extern void bitxor(void *dest, size_t destpos,
    const void *bits1, size_t pos1,
    const void *bits2, size_t pos2, size_t size);
+#endif
 extern void bitnot(void *dest, size_t destpos,
     const void *src, size_t srcpos, size_t size);
+extern void bitandn(void *dest, size_t destpos,
+    const void *const *bits, const size_t *pos, size_t count, size_t size);
+extern void bitorn(void *dest, size_t destpos,
+    const void *const *bits, const size_t *pos, size_t count, size_t size);
+extern void bitxorn(void *dest, size_t destpos,
+    const void *const *bits, const size_t *pos, size_t count, size_t size);
+extern void bitatleast(void *dest, size_t destpos, const void *const *bits,
+    const size_t *pos, size_t count, size_t size, size_t t);
+extern size_t bitcount(const void *bits, size_t pos, size_t size);
+extern size_t bitandcount(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size);
+extern size_t bitorcount(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size);
+extern size_t bitxorcount(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size);
+extern size_t bitnextset(const void *bits, size_t pos, size_t size);
+extern size_t bitnextclear(const void *bits, size_t pos, size_t size);
+extern size_t bitprevset(const void *bits, size_t pos, size_t size);
+extern size_t bitnextsetn(const void *bits, size_t pos, size_t size,
+    size_t *offsets, size_t n);
+
+typedef struct bitrank bitrank;
+
+extern bitrank *bitrankmake(const void *bits, size_t pos, size_t size);
+extern void bitrankfree(bitrank *r);
+extern void bitrankupdate(bitrank *r, size_t pos, size_t size);
+extern size_t bitrank1(const bitrank *r, size_t pos);
+extern size_t bitselect1(const bitrank *r, size_t k);
+
+typedef struct bitmap bitmap;
+
+extern bitmap *bitmapmake(const void *bits, size_t pos, size_t size);
+extern void bitmapfree(bitmap *m);
+extern size_t bitmapsize(const bitmap *m);
+extern size_t bitmapbytes(const bitmap *m);
+extern bool bitmapget(const bitmap *m, size_t pos);
+extern void bitmapcopy(void *dest, size_t destpos, const bitmap *m);
+extern bitmap *bitmapand(const bitmap *m1, const bitmap *m2);
+extern bitmap *bitmapor(const bitmap *m1, const bitmap *m2);
+extern bitmap *bitmapxor(const bitmap *m1, const bitmap *m2);
+extern bitmap *bitmapandnot(const bitmap *m1, const bitmap *m2);
+extern size_t bitmapcount(const bitmap *m);
+extern size_t bitmapandcount(const bitmap *m1, const bitmap *m2);
+extern size_t bitmaporcount(const bitmap *m1, const bitmap *m2);
+extern size_t bitmapxorcount(const bitmap *m1, const bitmap *m2);
+extern size_t bitmapandnotcount(const bitmap *m1, const bitmap *m2);
+
 extern void bitreverse(void *dest, size_t destpos,
     const void *src, size_t srcpos, size_t size);
 
@@ -84,6 +181,75 @@ extern void bitvinsertf(void *dest, size_t pos,
     const char *format, va_list ap);
 
 extern char *bitcompilef(const char *format, size_t *size);
+typedef struct bitcachestats {
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+  size_t size;
+  size_t capa;
+} bitcachestats;
+
+extern void bitcachesize(size_t capa);
+extern void bitcacheclear(void);
+extern void bitcachestat(bitcachestats *stats);
+
+extern size_t bitsscanc(const void *bits, size_t pos, const char *code, ...);
+extern size_t bitvsscanc(const void *bits, size_t pos,
+    const char *code, va_list ap);
+extern size_t bitsprintc(void *bits, size_t pos, const char *code, ...);
+extern size_t bitvsprintc(void *bits, size_t pos,
+    const char *code, va_list ap);
+
+typedef struct bitreader bitreader;
+
+extern bitreader *bitreaderopen(FILE *fp, size_t bufsize);
+extern void bitreaderclose(bitreader *r);
+extern size_t bitreadertell(const bitreader *r);
+extern size_t bitrscanc(bitreader *r, const char *code, ...);
+extern size_t bitvrscanc(bitreader *r, const char *code, va_list ap);
+extern size_t bitrscanf(bitreader *r, const char *format, ...);
+extern size_t bitvrscanf(bitreader *r, const char *format, va_list ap);
+
+typedef struct bitwriter bitwriter;
+
+extern bitwriter *bitwriteropen(int fd, size_t bufsize);
+extern bool bitwriterflush(bitwriter *w);
+extern bool bitwriterpad(bitwriter *w);
+extern bool bitwriterclose(bitwriter *w);
+extern size_t bitwritertell(const bitwriter *w);
+extern size_t bitwprintc(bitwriter *w, const char *code, ...);
+extern size_t bitvwprintc(bitwriter *w, const char *code, va_list ap);
+extern size_t bitwprintf(bitwriter *w, const char *format, ...);
+extern size_t bitvwprintf(bitwriter *w, const char *format, va_list ap);
+
+typedef struct bitlayout bitlayout;
+
+typedef struct bitview {
+  const bitlayout *layout;
+  const void *bits;
+  size_t pos;
+} bitview;
+
+extern bitlayout *bitlayoutc(const char *code);
+extern bitlayout *bitlayoutf(const char *format);
+extern void bitlayoutfree(bitlayout *layout);
+extern size_t bitlayoutsize(const bitlayout *layout);
+extern size_t bitlayoutcount(const bitlayout *layout);
+extern bitview bitviewmake(const bitlayout *layout,
+    const void *bits, size_t pos);
+extern uint64_t bitviewget(bitview view, size_t field);
+extern double bitviewgetf(bitview view, size_t field);
+extern size_t bitviewcopy(bitview view, size_t field, void *dest);
+extern bool bitviewvalid(bitview view);
+
+extern size_t bitbatchscanc(const void *bits, size_t pos,
+    size_t stride, size_t count, const char *code, ...);
+extern size_t bitvbatchscanc(const void *bits, size_t pos,
+    size_t stride, size_t count, const char *code, va_list ap);
+extern size_t bitbatchscanf(const void *bits, size_t pos,
+    size_t stride, size_t count, const char *format, ...);
+extern size_t bitvbatchscanf(const void *bits, size_t pos,
+    size_t stride, size_t count, const char *format, va_list ap);
 
 extern size_t bitprintf(const char *format, ...);
 extern size_t bitvprintf(const char *format, va_list ap);
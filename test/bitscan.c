@@ -0,0 +1,6017 @@
+/*
+ * Copyright (c) 2010 SUZUKI Tetsuya <suzuki@spice-of-life.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "bitscan.h"
+
+/* the kernels take 64-bit lanes and a 64-bit size_t */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#ifdef __GNUC__
+#define HAVE_TLS
+#define THREADLOCAL         __thread
+#define ATOMICADD(p,v)      __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define ATOMICLOAD(p)       __atomic_load_n((p), __ATOMIC_RELAXED)
+#define ATOMICSTORE(p,v)    __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#endif
+
+typedef enum BITOP {
+  ANDOP,
+  OROP,
+  XOROP,
+  NOTOP,
+  ANDNOTOP
+} BITOP;
+
+#define BYTE(x)             (x/8)
+#define ISBYTEALIGN(x)      (x%8==0)
+
+#define AT(bytes,idx)       ((uint8_t *)(bytes))[(idx)/8]
+#define SHIFTS(idx)         (7-(idx)%8)
+#define GET(bytes,idx)      \
+  ((AT(bytes,idx) & (1<<SHIFTS(idx))) >> SHIFTS(idx))
+#define SET(bytes,idx,v)    \
+  do {                                                      \
+    AT(bytes,idx) = (AT(bytes,idx) & ~(1<<SHIFTS(idx))) |   \
+      ((v)&1?1<<SHIFTS(idx):0);                             \
+  } while (0)
+
+/*
+ * compiled format code
+ *
+ * struct format {
+ *   uint8_t magic_number = 0xff;
+ *   size_t size;
+ *   size_t nparams;
+ *   struct param params[nparams]; 
+ * };
+ *
+ * The fields are packed without padding, and each param only has the
+ * value, pos and bits members its types need.
+ *
+ * struct param {
+ *   uint8_t value_type;
+ *   union {
+ *     long intval;
+ *     unsigned long uintval;
+ *     double floatval;
+ *     struct {
+ *       size_t size;
+ *       char s[size];
+ *     } strval;
+ *   } value;
+ *   uint8_t type_specifier;
+ *   uint8_t byte_order;
+ *   struct {
+ *     uint8_t null_type = POS_NULL;
+ *     struct {
+ *       uint8_t type = POS_VALUE;
+ *       size_t pos;
+ *     } value;
+ *     uint8_t var_type = POS_VAR;
+ *     uint8_t ptr_type = POS_PTR;
+ *     uint8_t cur_type = POS_CUR;
+ *   } pos_type;
+ *   struct {
+ *     uint8_t null_type = NBITS_NULL;
+ *     struct {
+ *       uint8_t type = NBITS_VALUE;
+ *       size_t pos;
+ *     } value;
+ *     uint8_t var_type = NBITS_VAR;
+ *     uint8_t ptr_type = NBITS_PTR;
+ *   } bits;
+ * };
+ *
+ */
+
+typedef enum OVERLAP {
+  OVERLAP_NONE,
+  OVERLAP_FORWARD,
+  OVERLAP_BACKWARD,
+  OVERLAP_SAME
+} OVERLAP;
+
+typedef enum VALUE_TYPE {
+  VALUE_NULL,
+  VALUE_NBASE,
+  VALUE_INT,
+  VALUE_UINT,
+  VALUE_FLOAT,
+  VALUE_STR
+} VALUE_TYPE;
+
+typedef enum TYPE_SPCR {
+  TYPE_CHAR,            /* c */
+  TYPE_UCHAR,           /* C */
+  TYPE_SHORT,           /* s */
+  TYPE_USHORT,          /* S */
+  TYPE_INT,             /* i */
+  TYPE_UINT,            /* I */
+  TYPE_LONG,            /* l */
+  TYPE_ULONG,           /* L */
+  TYPE_LLONG,           /* q */
+  TYPE_ULLONG,          /* Q */
+  TYPE_FLOAT,           /* f */
+  TYPE_DOUBLE,          /* d */
+  TYPE_PTR,             /* ^ */
+  TYPE_STR_NULL,        /* a */
+  TYPE_STR_NONNULL,     /* A */
+  TYPE_IGNORE,          /* # */
+} TYPE_SPCR;
+
+typedef enum ENDIAN {
+  ENDIAN_NATIVE,
+  ENDIAN_LITTLE,
+  ENDIAN_BIG,
+  ENDIAN_NETWORK,
+} ENDIAN;
+
+typedef enum POS_TYPE {
+  POS_NULL,
+  POS_VALUE,
+  POS_VAR,              /* ? */
+  POS_PTR,              /* ^ */
+  POS_CUR,              /* + */
+} POS_TYPE;
+
+typedef enum NBITS_TYPE {
+  NBITS_NULL,
+  NBITS_VALUE,
+  NBITS_VAR,            /* ? */
+  NBITS_PTR,            /* ^ */
+} NBITS_TYPE;
+
+#define MAGIC 0xff
+
+static void bitshift(void *dest, size_t destpos,
+    const void *src, size_t srcpos, size_t size, size_t shift, bool left);
+static void bitop(BITOP op, void *dest, size_t destpos,
+    const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size);
+
+#define MASK64(n)           ((n) >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << (n)) - 1)
+
+/*
+ * word access
+ *
+ * Bits are numbered from the most significant bit of the first byte,
+ * so a big-endian load gives a word whose top bit is the first bit.
+ */
+
+static inline uint64_t
+load64(const uint8_t *p)
+{
+  return (uint64_t)p[0] << 56 | (uint64_t)p[1] << 48 |
+    (uint64_t)p[2] << 40 | (uint64_t)p[3] << 32 |
+    (uint64_t)p[4] << 24 | (uint64_t)p[5] << 16 |
+    (uint64_t)p[6] << 8 | (uint64_t)p[7];
+}
+
+static inline void
+store64(uint8_t *p, uint64_t w)
+{
+  p[0] = (uint8_t)(w >> 56);
+  p[1] = (uint8_t)(w >> 48);
+  p[2] = (uint8_t)(w >> 40);
+  p[3] = (uint8_t)(w >> 32);
+  p[4] = (uint8_t)(w >> 24);
+  p[5] = (uint8_t)(w >> 16);
+  p[6] = (uint8_t)(w >> 8);
+  p[7] = (uint8_t)w;
+}
+
+/* returns n (1-64) bits at pos, right aligned. reads only the bytes
+ * covering the bits. */
+static inline uint64_t
+getbits(const void *bits, size_t pos, size_t n)
+{
+  const uint8_t *p;
+  size_t off, nbytes, i;
+  uint64_t w;
+
+  p = (const uint8_t *)bits + pos / 8;
+  off = pos % 8;
+  nbytes = (off + n + 7) / 8;
+  if (nbytes >= 8) {
+    w = load64(p) << off;
+    if (nbytes > 8)
+      w |= p[8] >> (8 - off);
+    return w >> (64 - n);
+  }
+
+  w = 0;
+  for (i = 0; i < nbytes; i++)
+    w = w << 8 | p[i];
+  return (w >> (nbytes * 8 - off - n)) & MASK64(n);
+}
+
+/* writes the lower n (0-64) bits of v at pos */
+static inline void
+putbits(void *bits, size_t pos, size_t n, uint64_t v)
+{
+  uint8_t *p, m;
+  size_t off, k;
+
+  p = (uint8_t *)bits + pos / 8;
+  off = pos % 8;
+  while (n > 0) {
+    k = 8 - off;
+    if (k > n)
+      k = n;
+    m = (uint8_t)(((1 << k) - 1) << (8 - off - k));
+    *p = (*p & ~m) | ((uint8_t)(v >> (n - k) << (8 - off - k)) & m);
+    n -= k;
+    off = 0;
+    p++;
+  }
+}
+
+/* compares the addresses of two bits */
+static inline int
+addrcmp(const void *bits1, size_t pos1, const void *bits2, size_t pos2)
+{
+  uintptr_t a1, a2;
+
+  a1 = (uintptr_t)bits1 + pos1 / 8;
+  a2 = (uintptr_t)bits2 + pos2 / 8;
+  if (a1 != a2)
+    return a1 < a2 ? -1 : 1;
+  else if (pos1 % 8 != pos2 % 8)
+    return pos1 % 8 < pos2 % 8 ? -1 : 1;
+  else
+    return 0;
+}
+
+/*
+ * Classifies how the destination range lies against the source range,
+ * in bit units. A forward pass is safe for OVERLAP_FORWARD (the
+ * destination starts before the source), a backward pass for
+ * OVERLAP_BACKWARD.
+ */
+static OVERLAP
+overlap(const void *dest, size_t destpos,
+    const void *src, size_t srcpos, size_t size)
+{
+  int c;
+
+  c = addrcmp(dest, destpos, src, srcpos);
+  if (c == 0)
+    return OVERLAP_SAME;
+  else if (c < 0)
+    return addrcmp(dest, destpos + size, src, srcpos) <= 0 ?
+      OVERLAP_NONE : OVERLAP_FORWARD;
+  else
+    return addrcmp(src, srcpos + size, dest, destpos) <= 0 ?
+      OVERLAP_NONE : OVERLAP_BACKWARD;
+}
+
+/*
+ * copy engine
+ *
+ * Copies the head bits up to a destination byte boundary, then moves
+ * the body as 64-bit words with funnel shifts (or memmove if the source
+ * is also byte aligned), then the tail bits. Each word is read before
+ * it is written, so copybits may be used when the destination starts
+ * at or before the source, and copybitsback when it starts after.
+ */
+static void
+copybits(void *dest, size_t destpos,
+    const void *src, size_t srcpos, size_t size)
+{
+  uint8_t *d;
+  const uint8_t *s;
+  size_t n, off;
+
+  if (destpos % 8 != 0) {
+    n = 8 - destpos % 8;
+    if (n > size)
+      n = size;
+    putbits(dest, destpos, n, getbits(src, srcpos, n));
+    destpos += n;
+    srcpos += n;
+    size -= n;
+  }
+
+  d = (uint8_t *)dest + destpos / 8;
+  s = (const uint8_t *)src + srcpos / 8;
+  off = srcpos % 8;
+  if (off == 0) {
+    memmove(d, s, size / 8);
+    d += size / 8;
+    s += size / 8;
+    size %= 8;
+  } else {
+    for (; size >= 64; size -= 64, d += 8, s += 8)
+      store64(d, load64(s) << off | s[8] >> (8 - off));
+  }
+
+  if (size > 0)
+    putbits(d, 0, size, getbits(s, off, size));
+}
+
+static void
+copybitsback(void *dest, size_t destpos,
+    const void *src, size_t srcpos, size_t size)
+{
+  uint8_t *d;
+  const uint8_t *s;
+  size_t n, off;
+
+  n = (destpos + size) % 8;
+  if (n > size)
+    n = size;
+  if (n > 0) {
+    size -= n;
+    putbits(dest, destpos + size, n, getbits(src, srcpos + size, n));
+  }
+
+  /* d and s point just after the remaining bits */
+  d = (uint8_t *)dest + (destpos + size) / 8;
+  s = (const uint8_t *)src + (srcpos + size) / 8;
+  off = (srcpos + size) % 8;
+  if (off == 0) {
+    n = size / 8;
+    memmove(d - n, s - n, n);
+    size %= 8;
+  } else {
+    for (; size >= 64; size -= 64, d -= 8, s -= 8)
+      store64(d - 8, load64(s - 8) << off | s[0] >> (8 - off));
+  }
+
+  if (size > 0)
+    putbits(dest, destpos, size, getbits(src, srcpos, size));
+}
+
+/*
+ * byte kernels
+ *
+ * Bulk operations on byte aligned ranges. The portable versions are
+ * replaced at load time with SSE2/AVX2/AVX-512 versions if the CPU
+ * supports them.
+ */
+
+#define BLOCKSIZE           512
+
+typedef void (*binkernel)(uint8_t *dest,
+    const uint8_t *src1, const uint8_t *src2, size_t n);
+typedef void (*unkernel)(uint8_t *dest, const uint8_t *src, size_t n);
+
+static void
+andbytes(uint8_t *dest, const uint8_t *src1, const uint8_t *src2, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    dest[i] = src1[i] & src2[i];
+}
+
+static void
+orbytes(uint8_t *dest, const uint8_t *src1, const uint8_t *src2, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    dest[i] = src1[i] | src2[i];
+}
+
+static void
+xorbytes(uint8_t *dest, const uint8_t *src1, const uint8_t *src2, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    dest[i] = src1[i] ^ src2[i];
+}
+
+static void
+notbytes(uint8_t *dest, const uint8_t *src, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    dest[i] = ~src[i];
+}
+
+#define R2(n)               n, n + 2*64, n + 1*64, n + 3*64
+#define R4(n)               R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+#define R6(n)               R4(n), R4(n + 2*4), R4(n + 1*4), R4(n + 3*4)
+
+/* bit reversed bytes */
+static const uint8_t revtable[256] = { R6(0), R6(2), R6(1), R6(3) };
+
+#undef R2
+#undef R4
+#undef R6
+
+/* reverses the order of the lower n (1-8) bits */
+#define REVBITS(v,n)        (revtable[(uint8_t)(v)] >> (8 - (n)))
+
+/* dest[i] = reversed src[n - i - 1] */
+static void
+revbytes(uint8_t *dest, const uint8_t *src, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    dest[i] = revtable[src[n - i - 1]];
+}
+
+/* dest[i] = n bits at pos + i * stride */
+typedef void (*gatherkernel)(uint64_t *dest, const uint8_t *bits,
+    size_t pos, size_t stride, size_t nbits, size_t n);
+
+static void
+gatherbits(uint64_t *dest, const uint8_t *bits,
+    size_t pos, size_t stride, size_t nbits, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++, pos += stride)
+    dest[i] = getbits(bits, pos, nbits);
+}
+
+/*
+ * returns the first bit b*8+k (b < n) where the 8 bytes from b masked
+ * with masks[k] equal needles[k], or SIZE_MAX
+ */
+typedef size_t (*findkernel)(const uint8_t *bytes, size_t n,
+    const uint64_t *needles, const uint64_t *masks);
+
+static size_t
+findbits(const uint8_t *bytes, size_t n,
+    const uint64_t *needles, const uint64_t *masks)
+{
+  size_t b, k;
+  uint64_t x;
+
+  for (b = 0; b < n; b++) {
+    x = load64(bytes + b);
+    for (k = 0; k < 8; k++) {
+      if ((x & masks[k]) == needles[k])
+        return b * 8 + k;
+    }
+  }
+  return SIZE_MAX;
+}
+
+static inline int
+clz64(uint64_t w)
+{
+#ifdef __GNUC__
+  return __builtin_clzll(w);
+#else
+  int n = 0;
+
+  while (!(w & (uint64_t)1 << 63)) {
+    w <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* without the instruction, gcc calls a table lookup in libgcc */
+static inline int
+popcount64(uint64_t w)
+{
+#if defined(__GNUC__) && defined(__POPCNT__)
+  return __builtin_popcountll(w);
+#else
+  w -= w >> 1 & 0x5555555555555555;
+  w = (w & 0x3333333333333333) + (w >> 2 & 0x3333333333333333);
+  w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0f;
+  return (int)(w * 0x0101010101010101 >> 56);
+#endif
+}
+
+/*
+ * returns the first bit b*8+k (b < n) where the 8 bytes from b shifted
+ * left by k differ from needle in at most maxerrors bits under mask, or
+ * SIZE_MAX
+ */
+typedef size_t (*approxkernel)(const uint8_t *bytes, size_t n,
+    uint64_t needle, uint64_t mask, size_t maxerrors);
+
+static size_t
+approxbits(const uint8_t *bytes, size_t n,
+    uint64_t needle, uint64_t mask, size_t maxerrors)
+{
+  size_t b, k;
+  uint64_t x;
+
+  for (b = 0; b < n; b++) {
+    x = load64(bytes + b);
+    for (k = 0; k < 8; k++) {
+      if ((size_t)popcount64((x << k ^ needle) & mask) <= maxerrors)
+        return b * 8 + k;
+    }
+  }
+  return SIZE_MAX;
+}
+
+/* returns the set bits of the bytes, or of op applied to two */
+typedef size_t (*countkernel)(const uint8_t *src, size_t n);
+typedef size_t (*bincountkernel)(const uint8_t *src1, const uint8_t *src2,
+    size_t n);
+
+/* the byte order does not matter to counts */
+static inline uint64_t
+loadword(const uint8_t *p)
+{
+  uint64_t w;
+
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+#define COUNTBYTES(name,attr,popcount)                                \
+  static attr size_t                                                  \
+  name(const uint8_t *src, size_t n)                                  \
+  {                                                                   \
+    size_t i, c = 0;                                                  \
+                                                                      \
+    for (i = 0; i + 8 <= n; i += 8)                                   \
+      c += (size_t)popcount(loadword(src + i));                       \
+    for (; i < n; i++)                                                \
+      c += (size_t)popcount(src[i]);                                  \
+    return c;                                                         \
+  }
+
+#define BINCOUNTBYTES(name,attr,popcount,op)                          \
+  static attr size_t                                                  \
+  name(const uint8_t *src1, const uint8_t *src2, size_t n)            \
+  {                                                                   \
+    size_t i, c = 0;                                                  \
+                                                                      \
+    for (i = 0; i + 8 <= n; i += 8)                                   \
+      c += (size_t)popcount(loadword(src1 + i) op loadword(src2 + i)); \
+    for (; i < n; i++)                                                \
+      c += (size_t)popcount((uint8_t)(src1[i] op src2[i]));           \
+    return c;                                                         \
+  }
+
+COUNTBYTES(countbytes, , popcount64)
+BINCOUNTBYTES(andcountbytes, , popcount64, &)
+BINCOUNTBYTES(orcountbytes, , popcount64, |)
+BINCOUNTBYTES(xorcountbytes, , popcount64, ^)
+
+/*
+ * writes the offsets from base of the set bits of the bytes to out from
+ * *nout, while 8 more fit in room. returns the bytes done.
+ */
+typedef size_t (*expandkernel)(const uint8_t *bytes, size_t n, size_t base,
+    size_t *out, size_t room, size_t *nout);
+
+static size_t
+expandbits(const uint8_t *bytes, size_t n, size_t base,
+    size_t *out, size_t room, size_t *nout)
+{
+  size_t i = 0, k = *nout;
+  uint64_t w;
+  int c;
+
+  while (i < n && k + 8 <= room) {
+    if (i + 32 <= n && (loadword(bytes + i) | loadword(bytes + i + 8) |
+          loadword(bytes + i + 16) | loadword(bytes + i + 24)) == 0) {
+      i += 32;
+      continue;
+    }
+    /* a word while its bits fit, else a byte */
+    if (i + 8 <= n && k + 64 <= room) {
+      w = load64(bytes + i);
+      c = 64;
+    } else {
+      w = (uint64_t)bytes[i] << 56;
+      c = 8;
+    }
+    for (; w != 0; w ^= (uint64_t)1 << 63 >> clz64(w))
+      out[k++] = base + i * 8 + (size_t)clz64(w);
+    i += (size_t)c / 8;
+  }
+  *nout = k;
+  return i;
+}
+
+static struct {
+  binkernel binop[3];   /* indexed by ANDOP, OROP, XOROP */
+  unkernel notop;
+  unkernel revop;
+  gatherkernel gather;  /* may read 8 bytes from each field */
+  findkernel find;
+  approxkernel approx;
+  countkernel count;
+  bincountkernel countop[3];
+  expandkernel expand;
+} kernels = {
+  { andbytes, orbytes, xorbytes },
+  notbytes,
+  revbytes,
+  gatherbits,
+  findbits,
+  approxbits,
+  countbytes,
+  { andcountbytes, orcountbytes, xorcountbytes },
+  expandbits
+};
+
+#ifdef HAVE_X86_KERNELS
+
+#define BINKERNEL(name,isa,vec,width,load,store,vop,op)               \
+  static __attribute__((target(isa))) void                            \
+  name(uint8_t *dest, const uint8_t *src1, const uint8_t *src2,       \
+      size_t n)                                                       \
+  {                                                                   \
+    size_t i;                                                         \
+                                                                      \
+    for (i = 0; i + width <= n; i += width)                           \
+      store((vec *)(dest + i), vop(load((const vec *)(src1 + i)),     \
+            load((const vec *)(src2 + i))));                          \
+    for (; i < n; i++)                                                \
+      dest[i] = src1[i] op src2[i];                                   \
+  }
+
+#define NOTKERNEL(name,isa,vec,width,load,store,vxor,ones)            \
+  static __attribute__((target(isa))) void                            \
+  name(uint8_t *dest, const uint8_t *src, size_t n)                   \
+  {                                                                   \
+    size_t i;                                                         \
+    vec m = ones;                                                     \
+                                                                      \
+    for (i = 0; i + width <= n; i += width)                           \
+      store((vec *)(dest + i), vxor(load((const vec *)(src + i)), m)); \
+    for (; i < n; i++)                                                \
+      dest[i] = ~src[i];                                              \
+  }
+
+BINKERNEL(andbytes_sse2, "sse2", __m128i, 16,
+    _mm_loadu_si128, _mm_storeu_si128, _mm_and_si128, &)
+BINKERNEL(orbytes_sse2, "sse2", __m128i, 16,
+    _mm_loadu_si128, _mm_storeu_si128, _mm_or_si128, |)
+BINKERNEL(xorbytes_sse2, "sse2", __m128i, 16,
+    _mm_loadu_si128, _mm_storeu_si128, _mm_xor_si128, ^)
+NOTKERNEL(notbytes_sse2, "sse2", __m128i, 16,
+    _mm_loadu_si128, _mm_storeu_si128, _mm_xor_si128, _mm_set1_epi32(-1))
+
+BINKERNEL(andbytes_avx2, "avx2", __m256i, 32,
+    _mm256_loadu_si256, _mm256_storeu_si256, _mm256_and_si256, &)
+BINKERNEL(orbytes_avx2, "avx2", __m256i, 32,
+    _mm256_loadu_si256, _mm256_storeu_si256, _mm256_or_si256, |)
+BINKERNEL(xorbytes_avx2, "avx2", __m256i, 32,
+    _mm256_loadu_si256, _mm256_storeu_si256, _mm256_xor_si256, ^)
+NOTKERNEL(notbytes_avx2, "avx2", __m256i, 32,
+    _mm256_loadu_si256, _mm256_storeu_si256, _mm256_xor_si256,
+    _mm256_set1_epi32(-1))
+
+BINKERNEL(andbytes_avx512, "avx512f", __m512i, 64,
+    _mm512_loadu_si512, _mm512_storeu_si512, _mm512_and_si512, &)
+BINKERNEL(orbytes_avx512, "avx512f", __m512i, 64,
+    _mm512_loadu_si512, _mm512_storeu_si512, _mm512_or_si512, |)
+BINKERNEL(xorbytes_avx512, "avx512f", __m512i, 64,
+    _mm512_loadu_si512, _mm512_storeu_si512, _mm512_xor_si512, ^)
+NOTKERNEL(notbytes_avx512, "avx512f", __m512i, 64,
+    _mm512_loadu_si512, _mm512_storeu_si512, _mm512_xor_si512,
+    _mm512_set1_epi32(-1))
+
+/*
+ * Reverses the byte order with pshufb, then the bits of each byte with
+ * two nibble lookups.
+ */
+static __attribute__((target("ssse3"))) void
+revbytes_ssse3(uint8_t *dest, const uint8_t *src, size_t n)
+{
+  const __m128i order = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0);
+  const __m128i nibble = _mm_setr_epi8(0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6,
+      0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf);
+  const __m128i low = _mm_set1_epi8(0x0f);
+  __m128i v;
+  size_t i;
+
+  for (i = 0; i + 16 <= n; i += 16) {
+    v = _mm_loadu_si128((const __m128i *)(src + n - i - 16));
+    v = _mm_shuffle_epi8(v, order);
+    v = _mm_or_si128(
+        _mm_slli_epi16(_mm_shuffle_epi8(nibble, _mm_and_si128(v, low)), 4),
+        _mm_shuffle_epi8(nibble, _mm_and_si128(_mm_srli_epi16(v, 4), low)));
+    _mm_storeu_si128((__m128i *)(dest + i), v);
+  }
+  for (; i < n; i++)
+    dest[i] = revtable[src[n - i - 1]];
+}
+
+static __attribute__((target("avx2"))) void
+revbytes_avx2(uint8_t *dest, const uint8_t *src, size_t n)
+{
+  const __m256i order = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0);
+  const __m256i nibble = _mm256_setr_epi8(0x0, 0x8, 0x4, 0xc, 0x2, 0xa,
+      0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf, 0x0, 0x8, 0x4,
+      0xc, 0x2, 0xa, 0x6, 0xe, 0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i v;
+  size_t i;
+
+  for (i = 0; i + 32 <= n; i += 32) {
+    v = _mm256_loadu_si256((const __m256i *)(src + n - i - 32));
+    v = _mm256_shuffle_epi8(v, order);
+    v = _mm256_permute2x128_si256(v, v, 1);
+    v = _mm256_or_si256(
+        _mm256_slli_epi16(
+          _mm256_shuffle_epi8(nibble, _mm256_and_si256(v, low)), 4),
+        _mm256_shuffle_epi8(nibble,
+          _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+    _mm256_storeu_si256((__m256i *)(dest + i), v);
+  }
+  for (; i < n; i++)
+    dest[i] = revtable[src[n - i - 1]];
+}
+
+/* fields of up to 57 bits are in the 8 bytes from their first byte */
+static __attribute__((target("avx2"))) void
+gatherbits_avx2(uint64_t *dest, const uint8_t *bits,
+    size_t pos, size_t stride, size_t nbits, size_t n)
+{
+  const __m256i order = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0,
+      15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+      15, 14, 13, 12, 11, 10, 9, 8);
+  const __m256i seven = _mm256_set1_epi64x(7);
+  const __m256i step = _mm256_set1_epi64x((long long)(stride * 4));
+  const __m128i right = _mm_cvtsi32_si128((int)(64 - nbits));
+  __m256i p, v;
+  size_t i = 0;
+
+  if (nbits <= 57) {
+    p = _mm256_setr_epi64x((long long)pos, (long long)(pos + stride),
+        (long long)(pos + stride * 2), (long long)(pos + stride * 3));
+    for (; i + 4 <= n; i += 4) {
+      v = _mm256_i64gather_epi64((const long long *)bits,
+          _mm256_srli_epi64(p, 3), 1);
+      v = _mm256_shuffle_epi8(v, order);
+      v = _mm256_sllv_epi64(v, _mm256_and_si256(p, seven));
+      _mm256_storeu_si256((__m256i *)(dest + i), _mm256_srl_epi64(v, right));
+      p = _mm256_add_epi64(p, step);
+    }
+  }
+  for (; i < n; i++)
+    dest[i] = getbits(bits, pos + i * stride, nbits);
+}
+
+/* the 8 alignments are compared at once */
+static __attribute__((target("avx2"))) size_t
+findbits_avx2(const uint8_t *bytes, size_t n,
+    const uint64_t *needles, const uint64_t *masks)
+{
+  const __m256i n0 = _mm256_loadu_si256((const __m256i *)needles);
+  const __m256i n1 = _mm256_loadu_si256((const __m256i *)(needles + 4));
+  const __m256i m0 = _mm256_loadu_si256((const __m256i *)masks);
+  const __m256i m1 = _mm256_loadu_si256((const __m256i *)(masks + 4));
+  __m256i x;
+  size_t b;
+  int hit;
+
+  for (b = 0; b < n; b++) {
+    x = _mm256_set1_epi64x((long long)load64(bytes + b));
+    hit = _mm256_movemask_pd(_mm256_castsi256_pd(
+          _mm256_cmpeq_epi64(_mm256_and_si256(x, m0), n0))) |
+      _mm256_movemask_pd(_mm256_castsi256_pd(
+            _mm256_cmpeq_epi64(_mm256_and_si256(x, m1), n1))) << 4;
+    if (hit != 0)
+      return b * 8 + __builtin_ctz(hit);
+  }
+  return SIZE_MAX;
+}
+
+static __attribute__((target("avx512f"))) size_t
+findbits_avx512(const uint8_t *bytes, size_t n,
+    const uint64_t *needles, const uint64_t *masks)
+{
+  const __m512i nv = _mm512_loadu_si512(needles);
+  const __m512i mv = _mm512_loadu_si512(masks);
+  __mmask8 hit;
+  size_t b;
+
+  for (b = 0; b < n; b++) {
+    hit = _mm512_cmpeq_epi64_mask(_mm512_and_si512(
+          _mm512_set1_epi64((long long)load64(bytes + b)), mv), nv);
+    if (hit != 0)
+      return b * 8 + __builtin_ctz(hit);
+  }
+  return SIZE_MAX;
+}
+
+static __attribute__((target("popcnt"))) size_t
+approxbits_popcnt(const uint8_t *bytes, size_t n,
+    uint64_t needle, uint64_t mask, size_t maxerrors)
+{
+  size_t b, k;
+  uint64_t x;
+
+  for (b = 0; b < n; b++) {
+    x = load64(bytes + b);
+    for (k = 0; k < 8; k++) {
+      if ((size_t)__builtin_popcountll((x << k ^ needle) & mask) <= maxerrors)
+        return b * 8 + k;
+    }
+  }
+  return SIZE_MAX;
+}
+
+/* nibble lookups, summed per lane */
+static __attribute__((target("avx2"))) inline __m256i
+popcount256(__m256i v)
+{
+  const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+      1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3,
+      1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+  __m256i c;
+
+  c = _mm256_add_epi8(
+      _mm256_shuffle_epi8(table, _mm256_and_si256(v, low)),
+      _mm256_shuffle_epi8(table,
+        _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+  return _mm256_sad_epu8(c, _mm256_setzero_si256());
+}
+
+static __attribute__((target("avx2"))) size_t
+approxbits_avx2(const uint8_t *bytes, size_t n,
+    uint64_t needle, uint64_t mask, size_t maxerrors)
+{
+  const __m256i k0 = _mm256_setr_epi64x(0, 1, 2, 3);
+  const __m256i k1 = _mm256_setr_epi64x(4, 5, 6, 7);
+  const __m256i nv = _mm256_set1_epi64x((long long)needle);
+  const __m256i mv = _mm256_set1_epi64x((long long)mask);
+  const __m256i ev = _mm256_set1_epi64x((long long)maxerrors);
+  __m256i x;
+  size_t b;
+  int over;
+
+  for (b = 0; b < n; b++) {
+    x = _mm256_set1_epi64x((long long)load64(bytes + b));
+    over = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(
+            popcount256(_mm256_and_si256(_mm256_xor_si256(
+                  _mm256_sllv_epi64(x, k0), nv), mv)), ev))) |
+      _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(
+              popcount256(_mm256_and_si256(_mm256_xor_si256(
+                    _mm256_sllv_epi64(x, k1), nv), mv)), ev))) << 4;
+    if (over != 0xff)
+      return b * 8 + __builtin_ctz(~over);
+  }
+  return SIZE_MAX;
+}
+
+static __attribute__((target("avx512f,avx512vpopcntdq"))) size_t
+approxbits_avx512(const uint8_t *bytes, size_t n,
+    uint64_t needle, uint64_t mask, size_t maxerrors)
+{
+  const __m512i kv = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m512i nv = _mm512_set1_epi64((long long)needle);
+  const __m512i mv = _mm512_set1_epi64((long long)mask);
+  const __m512i ev = _mm512_set1_epi64((long long)maxerrors);
+  __mmask8 hit;
+  size_t b;
+
+  for (b = 0; b < n; b++) {
+    hit = _mm512_cmple_epu64_mask(_mm512_popcnt_epi64(_mm512_and_si512(
+            _mm512_xor_si512(_mm512_sllv_epi64(
+                _mm512_set1_epi64((long long)load64(bytes + b)), kv), nv),
+            mv)), ev);
+    if (hit != 0)
+      return b * 8 + __builtin_ctz(hit);
+  }
+  return SIZE_MAX;
+}
+
+#define POPCNT              __attribute__((target("popcnt")))
+
+COUNTBYTES(countbytes_popcnt, POPCNT, __builtin_popcountll)
+BINCOUNTBYTES(andcountbytes_popcnt, POPCNT, __builtin_popcountll, &)
+BINCOUNTBYTES(orcountbytes_popcnt, POPCNT, __builtin_popcountll, |)
+BINCOUNTBYTES(xorcountbytes_popcnt, POPCNT, __builtin_popcountll, ^)
+
+static __attribute__((target("avx2"))) inline size_t
+sum256(__m256i v)
+{
+  __m128i s;
+
+  s = _mm_add_epi64(_mm256_castsi256_si128(v),
+      _mm256_extracti128_si256(v, 1));
+  return (size_t)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+/* vcount gives the counts of the 64-bit lanes, summed by reduce */
+#define COUNTKERNEL(name,isa,vec,width,load,vcount,vadd,reduce,zero)  \
+  static __attribute__((target(isa))) size_t                          \
+  name(const uint8_t *src, size_t n)                                  \
+  {                                                                   \
+    vec acc = zero;                                                   \
+    size_t i, c;                                                      \
+                                                                      \
+    for (i = 0; i + width <= n; i += width)                           \
+      acc = vadd(acc, vcount(load((const vec *)(src + i))));          \
+    c = (size_t)reduce(acc);                                          \
+    for (; i < n; i++)                                                \
+      c += (size_t)__builtin_popcount(src[i]);                        \
+    return c;                                                         \
+  }
+
+#define BINCOUNTKERNEL(name,isa,vec,width,load,vcount,vadd,reduce,zero, \
+    vop,op)                                                           \
+  static __attribute__((target(isa))) size_t                          \
+  name(const uint8_t *src1, const uint8_t *src2, size_t n)            \
+  {                                                                   \
+    vec acc = zero;                                                   \
+    size_t i, c;                                                      \
+                                                                      \
+    for (i = 0; i + width <= n; i += width)                           \
+      acc = vadd(acc, vcount(vop(load((const vec *)(src1 + i)),       \
+              load((const vec *)(src2 + i)))));                       \
+    c = (size_t)reduce(acc);                                          \
+    for (; i < n; i++)                                                \
+      c += (size_t)__builtin_popcount((uint8_t)(src1[i] op src2[i])); \
+    return c;                                                         \
+  }
+
+COUNTKERNEL(countbytes_avx2, "avx2", __m256i, 32, _mm256_loadu_si256,
+    popcount256, _mm256_add_epi64, sum256, _mm256_setzero_si256())
+BINCOUNTKERNEL(andcountbytes_avx2, "avx2", __m256i, 32, _mm256_loadu_si256,
+    popcount256, _mm256_add_epi64, sum256, _mm256_setzero_si256(),
+    _mm256_and_si256, &)
+BINCOUNTKERNEL(orcountbytes_avx2, "avx2", __m256i, 32, _mm256_loadu_si256,
+    popcount256, _mm256_add_epi64, sum256, _mm256_setzero_si256(),
+    _mm256_or_si256, |)
+BINCOUNTKERNEL(xorcountbytes_avx2, "avx2", __m256i, 32, _mm256_loadu_si256,
+    popcount256, _mm256_add_epi64, sum256, _mm256_setzero_si256(),
+    _mm256_xor_si256, ^)
+
+COUNTKERNEL(countbytes_avx512, "avx512f,avx512vpopcntdq", __m512i, 64,
+    _mm512_loadu_si512, _mm512_popcnt_epi64, _mm512_add_epi64,
+    _mm512_reduce_add_epi64, _mm512_setzero_si512())
+BINCOUNTKERNEL(andcountbytes_avx512, "avx512f,avx512vpopcntdq", __m512i, 64,
+    _mm512_loadu_si512, _mm512_popcnt_epi64, _mm512_add_epi64,
+    _mm512_reduce_add_epi64, _mm512_setzero_si512(), _mm512_and_si512, &)
+BINCOUNTKERNEL(orcountbytes_avx512, "avx512f,avx512vpopcntdq", __m512i, 64,
+    _mm512_loadu_si512, _mm512_popcnt_epi64, _mm512_add_epi64,
+    _mm512_reduce_add_epi64, _mm512_setzero_si512(), _mm512_or_si512, |)
+BINCOUNTKERNEL(xorcountbytes_avx512, "avx512f,avx512vpopcntdq", __m512i, 64,
+    _mm512_loadu_si512, _mm512_popcnt_epi64, _mm512_add_epi64,
+    _mm512_reduce_add_epi64, _mm512_setzero_si512(), _mm512_xor_si512, ^)
+
+/*
+ * skips to the first word with bits in 64 bytes, then compresses the
+ * offsets of the set bits of a byte at once
+ */
+static __attribute__((target("avx512f,popcnt"))) size_t
+expandbits_avx512(const uint8_t *bytes, size_t n, size_t base,
+    size_t *out, size_t room, size_t *nout)
+{
+  const __m512i lanes = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+  size_t i = 0, end, k = *nout;
+  __m512i v;
+  __mmask8 words;
+  uint8_t m;
+
+  while (i < n && k + 8 <= room) {
+    if (i + 64 <= n) {
+      v = _mm512_loadu_si512(bytes + i);
+      if ((words = _mm512_test_epi64_mask(v, v)) == 0) {
+        i += 64;
+        continue;
+      }
+      i += 8 * (size_t)__builtin_ctz(words);
+    }
+    end = i + 8 < n ? i + 8 : n;
+    for (; i < end && k + 8 <= room; i++) {
+      if (bytes[i] == 0)
+        continue;
+      m = revtable[bytes[i]];
+      _mm512_storeu_si512(out + k, _mm512_maskz_compress_epi64(m,
+            _mm512_add_epi64(lanes,
+              _mm512_set1_epi64((long long)(base + i * 8)))));
+      k += (size_t)__builtin_popcount(m);
+    }
+  }
+  *nout = k;
+  return i;
+}
+
+static __attribute__((constructor)) void
+initkernels(void)
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("popcnt")) {
+    kernels.approx = approxbits_popcnt;
+    kernels.count = countbytes_popcnt;
+    kernels.countop[ANDOP] = andcountbytes_popcnt;
+    kernels.countop[OROP] = orcountbytes_popcnt;
+    kernels.countop[XOROP] = xorcountbytes_popcnt;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    kernels.binop[ANDOP] = andbytes_sse2;
+    kernels.binop[OROP] = orbytes_sse2;
+    kernels.binop[XOROP] = xorbytes_sse2;
+    kernels.notop = notbytes_sse2;
+  }
+  if (__builtin_cpu_supports("ssse3"))
+    kernels.revop = revbytes_ssse3;
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.binop[ANDOP] = andbytes_avx2;
+    kernels.binop[OROP] = orbytes_avx2;
+    kernels.binop[XOROP] = xorbytes_avx2;
+    kernels.notop = notbytes_avx2;
+    kernels.revop = revbytes_avx2;
+    kernels.gather = gatherbits_avx2;
+    kernels.find = findbits_avx2;
+    kernels.approx = approxbits_avx2;
+    kernels.count = countbytes_avx2;
+    kernels.countop[ANDOP] = andcountbytes_avx2;
+    kernels.countop[OROP] = orcountbytes_avx2;
+    kernels.countop[XOROP] = xorcountbytes_avx2;
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    kernels.binop[ANDOP] = andbytes_avx512;
+    kernels.binop[OROP] = orbytes_avx512;
+    kernels.binop[XOROP] = xorbytes_avx512;
+    kernels.notop = notbytes_avx512;
+    kernels.find = findbits_avx512;
+    kernels.expand = expandbits_avx512;
+    if (__builtin_cpu_supports("avx512vpopcntdq")) {
+      kernels.approx = approxbits_avx512;
+      kernels.count = countbytes_avx512;
+      kernels.countop[ANDOP] = andcountbytes_avx512;
+      kernels.countop[OROP] = orcountbytes_avx512;
+      kernels.countop[XOROP] = xorcountbytes_avx512;
+    }
+  }
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+static inline uint64_t
+calc(BITOP op, uint64_t a, uint64_t b)
+{
+  switch (op) {
+  case ANDOP:
+    return a & b;
+  case OROP:
+    return a | b;
+  case XOROP:
+    return a ^ b;
+  case ANDNOTOP:
+    return a & ~b;
+  default:
+    return ~a;
+  }
+}
+
+/*
+ * Applies op to the bits. The head and tail bits are computed in
+ * words, and the body is passed to the byte kernels. Unaligned
+ * operands are realigned block by block into the stack buffers.
+ * bits2 is not used for NOTOP.
+ */
+static void
+opbits(BITOP op, void *dest, size_t destpos,
+    const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  uint8_t buf1[BLOCKSIZE], buf2[BLOCKSIZE], *d;
+  const uint8_t *s1, *s2;
+  size_t n;
+
+  if (destpos % 8 != 0) {
+    n = 8 - destpos % 8;
+    if (n > size)
+      n = size;
+    putbits(dest, destpos, n, calc(op, getbits(bits1, pos1, n),
+          op == NOTOP ? 0 : getbits(bits2, pos2, n)));
+    destpos += n;
+    pos1 += n;
+    pos2 += n;
+    size -= n;
+  }
+
+  d = (uint8_t *)dest + destpos / 8;
+  for (; size >= 8; size -= n * 8, pos1 += n * 8, pos2 += n * 8, d += n) {
+    n = size / 8;
+    if ((pos1 % 8 != 0 || (op != NOTOP && pos2 % 8 != 0)) &&
+        n > BLOCKSIZE)
+      n = BLOCKSIZE;
+
+    if (pos1 % 8 == 0) {
+      s1 = (const uint8_t *)bits1 + pos1 / 8;
+    } else {
+      copybits(buf1, 0, bits1, pos1, n * 8);
+      s1 = buf1;
+    }
+
+    if (op == NOTOP) {
+      kernels.notop(d, s1, n);
+      continue;
+    }
+
+    if (pos2 % 8 == 0) {
+      s2 = (const uint8_t *)bits2 + pos2 / 8;
+    } else {
+      copybits(buf2, 0, bits2, pos2, n * 8);
+      s2 = buf2;
+    }
+    kernels.binop[op](d, s1, s2, n);
+  }
+
+  if (size > 0)
+    putbits(d, 0, size, calc(op, getbits(bits1, pos1, size),
+          op == NOTOP ? 0 : getbits(bits2, pos2, size)));
+}
+
+/*
+ * Applies op from the end, block by block. Each block of the operands
+ * is staged in the stack buffers at the bit phase of the destination
+ * before it is written, so the destination may start after the
+ * operands.
+ */
+static void
+opbitsback(BITOP op, void *dest, size_t destpos,
+    const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  uint8_t buf1[BLOCKSIZE], buf2[BLOCKSIZE];
+  size_t n, off;
+
+  for (; size > 0; size -= n) {
+    n = size < (BLOCKSIZE - 1) * 8 ? size : (BLOCKSIZE - 1) * 8;
+    off = (destpos + size - n) % 8;
+    copybits(buf1, off, bits1, pos1 + size - n, n);
+    if (op != NOTOP)
+      copybits(buf2, off, bits2, pos2 + size - n, n);
+    opbits(op, dest, destpos + size - n, buf1, off, buf2, off, n);
+  }
+}
+
+int
+bitcmp(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  size_t i;
+
+  i = bitmismatch(bits1, pos1, bits2, pos2, size);
+  if (i == size)
+    return 0;
+  else if (GET(bits1, pos1 + i))
+    return 1;
+  else
+    return -1;
+}
+
+bool
+biteq(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  return (bool)(bitmismatch(bits1, pos1, bits2, pos2, size) == size);
+}
+
+/*
+ * Returns the index of the first differing bit, or size if the bits
+ * are equal. The first bits are aligned to a byte boundary, then the
+ * rest is compared with memcmp (both byte aligned) or 64-bit words
+ * shifted into line.
+ */
+size_t
+bitmismatch(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  const uint8_t *s1, *s2;
+  size_t i = 0, n, off;
+  uint64_t w;
+
+  if (pos1 % 8 != 0) {
+    n = 8 - pos1 % 8;
+    if (n > size)
+      n = size;
+    w = getbits(bits1, pos1, n) ^ getbits(bits2, pos2, n);
+    if (w != 0)
+      return clz64(w) - (64 - n);
+    i = n;
+  }
+
+  s1 = (const uint8_t *)bits1 + (pos1 + i) / 8;
+  s2 = (const uint8_t *)bits2 + (pos2 + i) / 8;
+  off = (pos2 + i) % 8;
+  if (off == 0) {
+    for (; size - i >= BLOCKSIZE * 8; i += BLOCKSIZE * 8) {
+      if (memcmp(s1, s2, BLOCKSIZE) != 0)
+        break;
+      s1 += BLOCKSIZE;
+      s2 += BLOCKSIZE;
+    }
+    for (; size - i >= 64; i += 64, s1 += 8, s2 += 8) {
+      w = load64(s1) ^ load64(s2);
+      if (w != 0)
+        return i + clz64(w);
+    }
+  } else {
+    for (; size - i >= 64; i += 64, s1 += 8, s2 += 8) {
+      w = load64(s1) ^ (load64(s2) << off | s2[8] >> (8 - off));
+      if (w != 0)
+        return i + clz64(w);
+    }
+  }
+
+  if (i < size) {
+    n = size - i;
+    w = getbits(s1, 0, n) ^ getbits(s2, off, n);
+    if (w != 0)
+      return i + clz64(w) - (64 - n);
+  }
+  return size;
+}
+
+/*
+ * search
+ *
+ * A needle of up to 64 bits is matched a haystack byte at a time, at
+ * all 8 alignments of the byte: the 8 bytes from there are compared
+ * with the needle shifted to each alignment, in the find kernel. The
+ * ends of the haystack, and needles over 56 bits, which need a 9th
+ * byte, are matched on funnel-shifted words. Longer needles are
+ * searched with a Horspool skip table on 12-bit grams.
+ */
+
+#define GRAMBITS            12
+
+/* returns the first k in kmin..kmax where the needle is at p[0] bit k */
+static int
+matchbyte(const uint8_t *p, size_t avail, uint64_t v, size_t nsize,
+    unsigned kmin, unsigned kmax)
+{
+  uint8_t tmp[9];
+  uint64_t x, w;
+  unsigned k;
+
+  if (avail < 9) {
+    memset(tmp, 0, sizeof(tmp));
+    memcpy(tmp, p, avail);
+    p = tmp;
+  }
+  x = load64(p);
+  for (k = kmin; k <= kmax; k++) {
+    w = k == 0 ? x : x << k | p[8] >> (8 - k);
+    if (w >> (64 - nsize) == v)
+      return (int)k;
+  }
+  return -1;
+}
+
+static size_t
+findshort(const uint8_t *bits, size_t pos, size_t size,
+    uint64_t v, size_t nsize)
+{
+  uint64_t needles[8], masks[8];
+  size_t b, b0, b1, e, mid, r, plen, last;
+  int k;
+
+  /* the kernel finds the first 56 bits at most, longer needles are checked */
+  plen = nsize < 56 ? nsize : 56;
+  for (k = 0; k < 8; k++) {
+    needles[k] = v >> (nsize - plen) << (64 - plen - k);
+    masks[k] = MASK64(plen) << (64 - plen - k);
+  }
+
+  last = pos + size - nsize;
+  b0 = pos / 8;
+  b1 = last / 8;
+  e = (pos + size + 7) / 8;
+  for (b = b0; b <= b1; b++) {
+    if (b > b0 && b < b1 && b + 8 <= e) {
+      /* all alignments of the middle bytes are in the haystack */
+      mid = b1 < e - 7 ? b1 : e - 7;
+      r = kernels.find(bits + b, mid - b, needles, masks);
+      if (r == SIZE_MAX) {
+        b = mid - 1;
+        continue;
+      }
+      r += b * 8;
+      if (nsize == plen || getbits(bits, r, nsize) == v)
+        return r - pos;
+      b = r / 8;
+      if (r % 8 == 7)
+        continue;
+      k = matchbyte(bits + b, e - b, v, nsize, r % 8 + 1, 7);
+    } else {
+      k = matchbyte(bits + b, e - b, v, nsize,
+          b == b0 ? pos % 8 : 0, b == b1 ? last % 8 : 7);
+    }
+    if (k >= 0)
+      return b * 8 + k - pos;
+  }
+  return size;
+}
+
+static size_t
+findlong(const uint8_t *bits, size_t pos, size_t size,
+    const void *needle, size_t npos, size_t nsize)
+{
+  uint32_t shift[1 << GRAMBITS];
+  size_t i, m, s;
+
+  /* shift to the last occurrence of the gram at the window end */
+  m = nsize - GRAMBITS;
+  for (i = 0; i < (1 << GRAMBITS); i++)
+    shift[i] = (uint32_t)(m + 1);
+  for (i = 0; i < m; i++)
+    shift[getbits(needle, npos + i, GRAMBITS)] = (uint32_t)(m - i);
+
+  for (s = 0; s + nsize <= size;
+      s += shift[getbits(bits, pos + s + m, GRAMBITS)]) {
+    if (biteq(bits, pos + s, needle, npos, nsize))
+      return s;
+  }
+  return size;
+}
+
+/*
+ * Returns the first offset from pos where the needle occurs, or size
+ * if it does not.
+ */
+size_t
+bitfind(const void *bits, size_t pos, size_t size,
+    const void *needle, size_t npos, size_t nsize)
+{
+  if (nsize == 0)
+    return 0;
+  else if (nsize > size)
+    return size;
+  else if (nsize <= 64)
+    return findshort((const uint8_t *)bits, pos, size,
+        getbits(needle, npos, nsize), nsize);
+  else
+    return findlong((const uint8_t *)bits, pos, size, needle, npos, nsize);
+}
+
+/* whether the needle differs from the bits at p in at most maxerrors */
+static bool
+approxeq(const void *bits, size_t p, const void *needle, size_t npos,
+    size_t nsize, size_t maxerrors)
+{
+  size_t i, n, errors = 0;
+
+  for (i = 0; i < nsize; i += n) {
+    n = nsize - i < 64 ? nsize - i : 64;
+    errors += (size_t)popcount64(getbits(bits, p + i, n) ^
+        getbits(needle, npos + i, n));
+    if (errors > maxerrors)
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Returns the first offset from pos where the needle occurs with at
+ * most maxerrors bits differing, or size if it does not. Needles of up
+ * to 56 bits are compared at the 8 alignments of a byte at once in the
+ * approx kernel.
+ */
+size_t
+bitfindapprox(const void *bits, size_t pos, size_t size,
+    const void *needle, size_t npos, size_t nsize, size_t maxerrors)
+{
+  size_t s, b, mid, r, last, e;
+  uint64_t v, mask;
+
+  if (nsize > size)
+    return size;
+  else if (maxerrors >= nsize)
+    return 0;
+
+  v = mask = 0;
+  if (nsize <= 56) {
+    v = getbits(needle, npos, nsize) << (64 - nsize);
+    mask = MASK64(nsize) << (64 - nsize);
+  }
+
+  last = size - nsize;
+  e = (pos + size + 7) / 8;
+  for (s = 0; s <= last; ) {
+    if (nsize <= 56 && (pos + s) % 8 == 0 && e >= 8) {
+      /* bytes whose alignments are all in the haystack */
+      b = (pos + s) / 8;
+      mid = (pos + last + 1) / 8;
+      if (mid > e - 7)
+        mid = e - 7;
+      if (mid > b) {
+        r = kernels.approx((const uint8_t *)bits + b, mid - b,
+            v, mask, maxerrors);
+        if (r != SIZE_MAX)
+          return b * 8 + r - pos;
+        s = mid * 8 - pos;
+        continue;
+      }
+    }
+    if (approxeq(bits, pos + s, needle, npos, nsize, maxerrors))
+      return s;
+    s++;
+  }
+  return size;
+}
+
+/*
+ * multi-pattern search
+ *
+ * The needles are compiled into an Aho-Corasick automaton over bits,
+ * and its transitions are tabled for a byte at a time. A byte whose
+ * steps pass a state where some needle ends is stepped again bit by
+ * bit to report the ends.
+ */
+
+#define FINDNONE            UINT32_MAX
+#define FINDHIT             ((uint32_t)1 << 31)
+
+struct bitfinder {
+  size_t count;
+  size_t *sizes;
+  uint32_t nstates;
+  uint32_t (*go)[2];
+  uint32_t *match;      /* the first needle ending at a state */
+  uint32_t *same;       /* the next needle equal to a needle */
+  uint32_t *dict;       /* the longest proper suffix state with a match */
+  uint32_t *step;       /* byte transitions, FINDHIT if passing a match */
+};
+
+static uint32_t
+finderout(const bitfinder *f, uint32_t s)
+{
+  return f->match[s] != FINDNONE ? s : f->dict[s];
+}
+
+bitfinder *
+bitfindermake(const void *const *needles, const size_t *npos,
+    const size_t *nsizes, size_t count)
+{
+  bitfinder *f;
+  uint32_t *fail, *queue;
+  uint32_t c, s, t, k, head, tail, *last;
+  size_t i, j, max;
+
+  max = 1;
+  for (i = 0; i < count; i++) {
+    if (nsizes[i] == 0)
+      return NULL;
+    max += nsizes[i];
+  }
+  if (max >= FINDHIT || count >= FINDNONE)
+    return NULL;
+
+  f = (bitfinder *)malloc(sizeof(bitfinder));
+  f->count = count;
+  f->sizes = (size_t *)malloc(sizeof(size_t) * (count + 1));
+  memcpy(f->sizes, nsizes, sizeof(size_t) * count);
+  f->go = (uint32_t (*)[2])calloc(max, sizeof(uint32_t [2]));
+  f->match = (uint32_t *)malloc(sizeof(uint32_t) * max);
+  f->same = (uint32_t *)malloc(sizeof(uint32_t) * (count + 1));
+  f->dict = (uint32_t *)calloc(max, sizeof(uint32_t));
+  memset(f->match, 0xff, sizeof(uint32_t) * max);
+
+  /* the trie, in which 0 is no child as the root is no one's child */
+  f->nstates = 1;
+  for (i = 0; i < count; i++) {
+    s = 0;
+    for (j = 0; j < nsizes[i]; j++) {
+      c = bitget(needles[i], npos[i] + j);
+      if (f->go[s][c] == 0)
+        f->go[s][c] = f->nstates++;
+      s = f->go[s][c];
+    }
+    f->same[i] = FINDNONE;
+    for (last = &f->match[s]; *last != FINDNONE; last = &f->same[*last])
+      ;
+    *last = (uint32_t)i;
+  }
+
+  /* failure links in breadth first order, completing the transitions */
+  fail = (uint32_t *)calloc(f->nstates, sizeof(uint32_t));
+  queue = (uint32_t *)malloc(sizeof(uint32_t) * f->nstates);
+  head = tail = 0;
+  for (c = 0; c < 2; c++) {
+    if ((t = f->go[0][c]) != 0)
+      queue[tail++] = t;
+  }
+  while (head < tail) {
+    s = queue[head++];
+    for (c = 0; c < 2; c++) {
+      t = f->go[s][c];
+      if (t == 0) {
+        f->go[s][c] = f->go[fail[s]][c];
+        continue;
+      }
+      fail[t] = f->go[fail[s]][c];
+      f->dict[t] = finderout(f, fail[t]);
+      queue[tail++] = t;
+    }
+  }
+  free(fail);
+  free(queue);
+
+  f->step = (uint32_t *)malloc(sizeof(uint32_t) * 256 * f->nstates);
+  for (s = 0; s < f->nstates; s++) {
+    for (c = 0; c < 256; c++) {
+      t = s;
+      f->step[s * 256 + c] = 0;
+      for (k = 8; k-- > 0; ) {
+        t = f->go[t][c >> k & 1];
+        if (finderout(f, t) != 0)
+          f->step[s * 256 + c] = FINDHIT;
+      }
+      f->step[s * 256 + c] |= t;
+    }
+  }
+  return f;
+}
+
+void
+bitfinderfree(bitfinder *f)
+{
+  free(f->sizes);
+  free(f->go);
+  free(f->match);
+  free(f->same);
+  free(f->dict);
+  free(f->step);
+  free(f);
+}
+
+bitfinditer
+bitfindbegin(const bitfinder *f, const void *bits, size_t pos, size_t size)
+{
+  bitfinditer it;
+
+  it.finder = f;
+  it.bits = bits;
+  it.pos = pos;
+  it.size = size;
+  it.at = 0;
+  it.state = 0;
+  it.out = 0;
+  it.id = FINDNONE;
+  return it;
+}
+
+/*
+ * Stores the needle and the offset from pos of the next occurrence and
+ * returns true, or returns false at the end. Occurrences are in the
+ * order of their ends.
+ */
+bool
+bitfindnext(bitfinditer *it, size_t *id, size_t *offset)
+{
+  const bitfinder *f = it->finder;
+  const uint8_t *bits = (const uint8_t *)it->bits;
+  size_t at = it->at, end = it->size, pos = it->pos;
+  uint32_t s = it->state, t;
+
+  if (it->out == 0) {
+    for (;;) {
+      if ((pos + at) % 8 == 0) {
+        /* whole bytes until one passes a match */
+        while (at + 8 <= end) {
+          t = f->step[s * 256 + bits[(pos + at) / 8]];
+          if (t & FINDHIT)
+            break;
+          s = t;
+          at += 8;
+        }
+      }
+      if (at >= end) {
+        it->at = at;
+        it->state = s;
+        return false;
+      }
+      s = f->go[s][GET(bits, pos + at)];
+      at++;
+      if ((t = finderout(f, s)) != 0) {
+        it->out = t;
+        it->id = f->match[t];
+        break;
+      }
+    }
+    it->at = at;
+    it->state = s;
+  }
+
+  *id = it->id;
+  *offset = it->at - f->sizes[it->id];
+  if ((it->id = f->same[it->id]) == FINDNONE &&
+      (it->out = f->dict[it->out]) != 0)
+    it->id = f->match[it->out];
+  return true;
+}
+
+/*
+ * masked patterns
+ *
+ * A pattern of '0', '1' and don't-care '?' or 'x' characters is compiled
+ * into value and mask words. Spaces and '_' may separate the bits.
+ */
+
+struct bitpattern {
+  size_t size;
+  size_t plen;          /* the bits at the kernel alignments */
+  uint64_t needles[8];
+  uint64_t masks[8];
+  uint64_t words[];     /* value and mask pairs of 64 bits, right aligned */
+};
+
+bitpattern *
+bitpatternmake(const char *text)
+{
+  bitpattern *p;
+  const char *c;
+  size_t size, i;
+  uint64_t value, mask;
+  int k;
+
+  size = 0;
+  for (c = text; *c != '\0'; c++) {
+    switch (*c) {
+    case '0': case '1': case '?': case 'x': case 'X':
+      size++;
+      break;
+    case ' ': case '_':
+      break;
+    default:
+      return NULL;
+    }
+  }
+
+  p = (bitpattern *)malloc(sizeof(bitpattern) +
+      sizeof(uint64_t) * 2 * ((size + 63) / 64));
+  p->size = size;
+  i = 0;
+  value = mask = 0;
+  for (c = text; *c != '\0'; c++) {
+    if (*c == ' ' || *c == '_')
+      continue;
+    value = value << 1 | (*c == '1');
+    mask = mask << 1 | (*c == '0' || *c == '1');
+    if (++i % 64 == 0 || i == size) {
+      p->words[(i - 1) / 64 * 2] = value;
+      p->words[(i - 1) / 64 * 2 + 1] = mask;
+      value = mask = 0;
+    }
+  }
+
+  /* the first word shifted to each alignment of a byte */
+  p->plen = size < 56 ? size : 56;
+  if (size > 0) {
+    value = p->words[0] >> ((size < 64 ? size : 64) - p->plen);
+    mask = p->words[1] >> ((size < 64 ? size : 64) - p->plen);
+    for (k = 0; k < 8; k++) {
+      p->needles[k] = value << (64 - p->plen - k);
+      p->masks[k] = mask << (64 - p->plen - k);
+    }
+  }
+  return p;
+}
+
+void
+bitpatternfree(bitpattern *p)
+{
+  free(p);
+}
+
+size_t
+bitpatternsize(const bitpattern *p)
+{
+  return p->size;
+}
+
+/* whether the pattern matches the bits at pos */
+bool
+bitmatch(const void *bits, size_t pos, const bitpattern *p)
+{
+  size_t i, n;
+
+  for (i = 0; i < p->size; i += n) {
+    n = p->size - i < 64 ? p->size - i : 64;
+    if ((getbits(bits, pos + i, n) ^ p->words[i / 32]) & p->words[i / 32 + 1])
+      return false;
+  }
+  return true;
+}
+
+/*
+ * Returns the first offset from pos where the pattern matches, or size
+ * if it does not. The first 56 bits are found with the find kernel.
+ */
+size_t
+bitmatchscan(const void *bits, size_t pos, size_t size, const bitpattern *p)
+{
+  size_t s, b, mid, r, last, e;
+
+  if (p->size == 0)
+    return 0;
+  else if (p->size > size)
+    return size;
+
+  last = size - p->size;
+  e = (pos + size + 7) / 8;
+  for (s = 0; s <= last; ) {
+    if ((pos + s) % 8 == 0 && e >= 8) {
+      /* bytes whose alignments are all in the haystack */
+      b = (pos + s) / 8;
+      mid = (pos + last + 1) / 8;
+      if (mid > e - 7)
+        mid = e - 7;
+      if (mid > b) {
+        r = kernels.find((const uint8_t *)bits + b, mid - b,
+            p->needles, p->masks);
+        if (r == SIZE_MAX) {
+          s = mid * 8 - pos;
+          continue;
+        }
+        s = b * 8 + r - pos;
+        if (p->size == p->plen || bitmatch(bits, pos + s, p))
+          return s;
+        s++;
+        continue;
+      }
+    }
+    if (bitmatch(bits, pos + s, p))
+      return s;
+    s++;
+  }
+  return size;
+}
+
+bool
+bitget(const void *bits, size_t pos)
+{
+  return (bool)GET(bits, pos);
+}
+
+void
+bitset(void *bits, size_t pos, bool value)
+{
+  SET(bits, pos, value);
+}
+
+void
+bitsets(void *bits, size_t pos, uint8_t byte, size_t size)
+{
+  bitfill(bits, pos, size * 8, byte, 8);
+}
+
+void
+bitcpy(void *dest, size_t destpos,
+    const void *src, size_t srcpos, size_t size)
+{
+  switch (overlap(dest, destpos, src, srcpos, size)) {
+  case OVERLAP_SAME:
+    break;
+  case OVERLAP_BACKWARD:
+    copybitsback(dest, destpos, src, srcpos, size);
+    break;
+  default:
+    copybits(dest, destpos, src, srcpos, size);
+    break;
+  }
+}
+
+void
+bitclear(void *bits, size_t pos, size_t size)
+{
+  uint8_t *p;
+  size_t off;
+
+  if (size == 0)
+    return;
+
+  p = (uint8_t *)bits + pos / 8;
+  off = pos % 8;
+  if (off + size <= 8) {
+    *p &= ~((0xff >> off) & (0xff << (8 - off - size)));
+    return;
+  }
+
+  if (off != 0) {
+    *p++ &= 0xff << (8 - off);
+    size -= 8 - off;
+  }
+  memset(p, 0, size / 8);
+  if (size % 8 != 0)
+    p[size / 8] &= 0xff >> (size % 8);
+}
+
+/* returns n (1-64) bits of the repeated pattern from the phase */
+static uint64_t
+repeatbits(uint64_t pattern, size_t patternbits, size_t phase, size_t n)
+{
+  uint64_t w = 0;
+  size_t k;
+
+  phase %= patternbits;
+  for (; n > 0; n -= k, phase = 0) {
+    k = patternbits - phase;
+    if (k > n)
+      k = n;
+    w = (k == 64 ? 0 : w << k) |
+      ((pattern >> (patternbits - phase - k)) & MASK64(k));
+  }
+  return w;
+}
+
+/*
+ * Fills the bits with the lower patternbits (1-64) bits of the pattern
+ * repeatedly, from the most significant one. patternbits bytes of the
+ * filled bits are a whole period at a byte boundary, so the body is
+ * written by memset (if the period divides a byte) or by doubling
+ * memcpy of the first period.
+ */
+void
+bitfill(void *bits, size_t pos, size_t size,
+    uint64_t pattern, size_t patternbits)
+{
+  uint8_t *d;
+  size_t n, i, phase, nbytes, done, limit;
+
+  if (size == 0 || patternbits == 0 || patternbits > 64)
+    return;
+
+  pattern &= MASK64(patternbits);
+  phase = 0;
+  if (pos % 8 != 0) {
+    n = 8 - pos % 8;
+    if (n > size)
+      n = size;
+    putbits(bits, pos, n, repeatbits(pattern, patternbits, 0, n));
+    pos += n;
+    size -= n;
+    phase = n;
+  }
+
+  d = (uint8_t *)bits + pos / 8;
+  nbytes = size / 8;
+  if (nbytes > 0) {
+    if (8 % patternbits == 0) {
+      memset(d, (int)repeatbits(pattern, patternbits, phase, 8), nbytes);
+    } else {
+      n = patternbits < nbytes ? patternbits : nbytes;
+      for (i = 0; i < n; i++)
+        d[i] = (uint8_t)repeatbits(pattern, patternbits,
+            phase + i * 8, 8);
+      limit = 65536 / patternbits * patternbits;
+      for (done = n; done < nbytes; done += n) {
+        n = done < limit ? done : limit;
+        if (n > nbytes - done)
+          n = nbytes - done;
+        memcpy(d + done, d, n);
+      }
+    }
+    d += nbytes;
+    phase += nbytes * 8;
+  }
+
+  if (size % 8 != 0)
+    putbits(d, 0, size % 8,
+        repeatbits(pattern, patternbits, phase, size % 8));
+}
+
+void
+bitrand(void *bits, size_t pos, size_t size,
+    size_t randsize, void (*rand)(void *buf))
+{
+  size_t i;
+  uint8_t *buf;
+
+  if (size == 0 || randsize == 0)
+    return;
+
+  buf = (uint8_t *)malloc((randsize + 7) / 8);
+  for (i = 0; i < size; i += randsize) {
+    rand(buf);
+    bitcpy(bits, pos + i, buf, 0, size - i < randsize ? size - i : randsize);
+  }
+  free(buf);
+}
+
+static void
+stdrand(void *buf)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof(int); i++)
+    ((uint8_t *)buf)[i] = (uint8_t)(random() >> 8);
+}
+
+void
+bitstdrand(void *bits, size_t pos, size_t size)
+{
+  bitrand(bits, pos, size, sizeof(int) * 8, stdrand);
+}
+
+/*
+ * xoshiro256** generator
+ *
+ * The state holds BITRANDLANES generators interleaved word by word, so
+ * that a step of all the lanes is a plain loop the compiler can
+ * vectorize. The lanes are 2^128 steps apart. A stream is seeded with
+ * a sequence of its own mixed in, which is unlike splitmix64 so that a
+ * stream does not cancel or mirror the seed, and any stream id takes
+ * the same time to set up.
+ */
+
+#define ROTL(x,k)           ((x) << (k) | (x) >> (64 - (k)))
+
+static uint64_t
+splitmix64(uint64_t *x)
+{
+  uint64_t z;
+
+  z = (*x += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+/* the sequence of a stream, another gamma and the murmur3 finalizer */
+static uint64_t
+streammix(uint64_t *x)
+{
+  uint64_t z;
+
+  z = (*x += 0xd1b54a32d192ed03);
+  z = (z ^ (z >> 33)) * 0xff51afd7ed558ccd;
+  z = (z ^ (z >> 33)) * 0xc4ceb9fe1a85ec53;
+  return z ^ (z >> 33);
+}
+
+static void
+xoshirojump(uint64_t s[4], const uint64_t poly[4])
+{
+  uint64_t t[4] = { 0, 0, 0, 0 }, u;
+  int i, b, j;
+
+  for (i = 0; i < 4; i++) {
+    for (b = 0; b < 64; b++) {
+      if (poly[i] & (uint64_t)1 << b) {
+        for (j = 0; j < 4; j++)
+          t[j] ^= s[j];
+      }
+      u = s[1] << 17;
+      s[2] ^= s[0];
+      s[3] ^= s[1];
+      s[1] ^= s[2];
+      s[0] ^= s[3];
+      s[2] ^= u;
+      s[3] = ROTL(s[3], 45);
+    }
+  }
+  memcpy(s, t, sizeof(t));
+}
+
+void
+bitrandseed(bitrandstate *state, uint64_t seed, uint64_t stream)
+{
+  static const uint64_t jump[4] = {
+    0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+    0xa9582618e03fc9aa, 0x39abdc4529b1661c
+  };
+  uint64_t s[4];
+  int i, j;
+
+  for (i = 0; i < 4; i++)
+    s[i] = splitmix64(&seed);
+  if (stream > 0) {
+    for (i = 0; i < 4; i++)
+      s[i] ^= streammix(&stream);
+  }
+  /* xoshiro256** never leaves the zero state */
+  if ((s[0] | s[1] | s[2] | s[3]) == 0)
+    s[0] = 0x9e3779b97f4a7c15;
+
+  for (j = 0; j < BITRANDLANES; j++) {
+    for (i = 0; i < 4; i++)
+      state->s[i][j] = s[i];
+    xoshirojump(s, jump);
+  }
+}
+
+static void
+randstep(bitrandstate *state, uint64_t out[BITRANDLANES])
+{
+  uint64_t (*s)[BITRANDLANES] = state->s, t;
+  int j;
+
+  for (j = 0; j < BITRANDLANES; j++) {
+    out[j] = ROTL(s[1][j] * 5, 7) * 9;
+    t = s[1][j] << 17;
+    s[2][j] ^= s[0][j];
+    s[3][j] ^= s[1][j];
+    s[1][j] ^= s[2][j];
+    s[0][j] ^= s[3][j];
+    s[2][j] ^= t;
+    s[3][j] = ROTL(s[3][j], 45);
+  }
+}
+
+/*
+ * Fills the bits with random bits. The output depends only on the
+ * state and the size, and the state advances by (size + 255) / 256
+ * steps.
+ */
+void
+bitrandfill(bitrandstate *state, void *bits, size_t pos, size_t size)
+{
+  uint64_t w[BITRANDLANES];
+  uint8_t *d;
+  size_t n;
+  int j;
+
+  if (size == 0)
+    return;
+
+  d = (uint8_t *)bits + pos / 8;
+  pos %= 8;
+  if (pos == 0) {
+    for (; size >= BITRANDLANES * 64; size -= BITRANDLANES * 64) {
+      randstep(state, w);
+      for (j = 0; j < BITRANDLANES; j++, d += 8)
+        store64(d, w[j]);
+    }
+  }
+
+  for (j = BITRANDLANES; size > 0; j++, size -= n, pos += n) {
+    if (j == BITRANDLANES) {
+      randstep(state, w);
+      j = 0;
+    }
+    n = size < 64 ? size : 64;
+    putbits(d, pos, n, w[j] >> (64 - n));
+  }
+}
+
+static void
+bitshift(void *dest, size_t destpos, const void *src, size_t srcpos,
+    size_t size, size_t shift, bool left)
+{
+  if (shift == 0) {
+    bitcpy(dest, destpos, src, srcpos, size);
+    return;
+  }
+
+  /* bitcpy reads all the source bits before the rest is cleared */
+  if (left) {
+    if (shift >= size) {
+      bitclear(dest, destpos, size);
+    } else {
+      bitcpy(dest, destpos, src, srcpos + shift, size - shift);
+      bitclear(dest, destpos + size - shift, shift);
+    }
+  } else {
+    /* the bits up to and including the shift-th bit are cleared */
+    if (shift >= size) {
+      bitclear(dest, destpos, size);
+    } else {
+      bitcpy(dest, destpos + shift + 1, src, srcpos + 1,
+          size - shift - 1);
+      bitclear(dest, destpos, shift + 1);
+    }
+  }
+}
+
+void
+bitlshift(void *dest, size_t destpos, const void *src, size_t srcpos,
+    size_t size, size_t shift)
+{
+  bitshift(dest, destpos, src, srcpos, size, shift, true);
+}
+
+void
+bitrshift(void *dest, size_t destpos, const void *src, size_t srcpos,
+    size_t size, size_t shift)
+{
+  bitshift(dest, destpos, src, srcpos, size, shift, false);
+}
+
+/* swaps two ranges that do not overlap */
+static void
+swapbits(void *bits1, size_t pos1, void *bits2, size_t pos2, size_t size)
+{
+  uint8_t buf[BLOCKSIZE];
+  size_t n;
+
+  for (; size > 0; size -= n, pos1 += n, pos2 += n) {
+    n = size < BLOCKSIZE * 8 ? size : BLOCKSIZE * 8;
+    copybits(buf, 0, bits1, pos1, n);
+    copybits(bits1, pos1, bits2, pos2, n);
+    copybits(bits2, pos2, buf, 0, n);
+  }
+}
+
+/*
+ * Rotates the bits to the left in place (0 < shift < size). If the
+ * shorter side fits in the stack buffer, it is saved and the other side
+ * is moved over it. Otherwise the shorter side is swapped with the
+ * opposite end of the range (Gries-Mills block swap), which puts it at
+ * its final place and leaves a smaller rotation.
+ */
+static void
+rotatebits(void *bits, size_t pos, size_t size, size_t shift)
+{
+  uint8_t buf[BLOCKSIZE];
+  size_t n;
+
+  while (shift != 0 && shift != size) {
+    n = size - shift;
+    if (shift <= BLOCKSIZE * 8) {
+      copybits(buf, 0, bits, pos, shift);
+      copybits(bits, pos, bits, pos + shift, n);
+      copybits(bits, pos + n, buf, 0, shift);
+      return;
+    } else if (n <= BLOCKSIZE * 8) {
+      copybits(buf, 0, bits, pos + shift, n);
+      copybitsback(bits, pos + n, bits, pos, shift);
+      copybits(bits, pos, buf, 0, n);
+      return;
+    } else if (shift <= n) {
+      swapbits(bits, pos, bits, pos + n, shift);
+      size -= shift;
+    } else {
+      swapbits(bits, pos, bits, pos + shift, n);
+      pos += n;
+      size -= n;
+      shift -= n;
+    }
+  }
+}
+
+static void
+bitrotate(void *dest, size_t destpos, const void *src, size_t srcpos,
+    size_t size, size_t shift, bool left)
+{
+  if (size == 0)
+    return;
+
+  shift %= size;
+  if (!left && shift != 0)
+    shift = size - shift;
+  if (shift == 0) {
+    bitcpy(dest, destpos, src, srcpos, size);
+    return;
+  }
+
+  if (overlap(dest, destpos, src, srcpos, size) == OVERLAP_NONE) {
+    copybits(dest, destpos, src, srcpos + shift, size - shift);
+    copybits(dest, destpos + size - shift, src, srcpos, shift);
+  } else {
+    bitcpy(dest, destpos, src, srcpos, size);
+    rotatebits(dest, destpos, size, shift);
+  }
+}
+
+void
+bitlrotate(void *dest, size_t destpos, const void *src, size_t srcpos,
+    size_t size, size_t shift)
+{
+  bitrotate(dest, destpos, src, srcpos, size, shift, true);
+}
+
+void
+bitrrotate(void *dest, size_t destpos, const void *src, size_t srcpos,
+    size_t size, size_t shift)
+{
+  bitrotate(dest, destpos, src, srcpos, size, shift, false);
+}
+
+
+static void
+bitop(BITOP op, void *dest, size_t destpos,
+    const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  OVERLAP ov1, ov2;
+  uint8_t *temp;
+
+  if (size == 0)
+    return;
+
+  ov1 = overlap(dest, destpos, bits1, pos1, size);
+  ov2 = overlap(dest, destpos, bits2, pos2, size);
+  if (ov1 != OVERLAP_BACKWARD && ov2 != OVERLAP_BACKWARD) {
+    opbits(op, dest, destpos, bits1, pos1, bits2, pos2, size);
+  } else if (ov1 != OVERLAP_FORWARD && ov2 != OVERLAP_FORWARD) {
+    opbitsback(op, dest, destpos, bits1, pos1, bits2, pos2, size);
+  } else {
+    /* the destination lies between the operands */
+    temp = (uint8_t *)malloc(size / 8 + 1);
+    copybits(temp, 0, bits2, pos2, size);
+    bitop(op, dest, destpos, bits1, pos1, temp, 0, size);
+    free(temp);
+  }
+}
+
+void
+bitand(void *dest, size_t destpos, const void *bits1, size_t pos1,
+   const void *bits2, size_t pos2, size_t size)
+{
+  bitop(ANDOP, dest, destpos, bits1, pos1, bits2, pos2, size);
+}
+
+void
+bitor(void *dest, size_t destpos, const void *bits1, size_t pos1,
+   const void *bits2, size_t pos2, size_t size)
+{
+  bitop(OROP, dest, destpos, bits1, pos1, bits2, pos2, size);
+}
+
+void
+bitxor(void *dest, size_t destpos, const void *bits1, size_t pos1,
+   const void *bits2, size_t pos2, size_t size)
+{
+  bitop(XOROP, dest, destpos, bits1, pos1, bits2, pos2, size);
+}
+
+void
+bitnot(void *dest, size_t destpos,
+    const void *src, size_t srcpos, size_t size)
+{
+  if (size == 0)
+    return;
+
+  if (overlap(dest, destpos, src, srcpos, size) == OVERLAP_BACKWARD)
+    opbitsback(NOTOP, dest, destpos, src, srcpos, NULL, 0, size);
+  else
+    opbits(NOTOP, dest, destpos, src, srcpos, NULL, 0, size);
+}
+
+/* the n bytes of the bits from pos, in buf unless pos is aligned */
+static inline const uint8_t *
+tilebytes(const void *bits, size_t pos, size_t n, uint8_t *buf)
+{
+  if (pos % 8 == 0)
+    return (const uint8_t *)bits + pos / 8;
+  copybits(buf, 0, bits, pos, n * 8);
+  return buf;
+}
+
+/*
+ * Applies op to count operands tile by tile. Each tile of the operands
+ * is combined into the stack buffer by the byte kernels and written
+ * once, so the operands are read once whatever their count. The head
+ * and tail bits are computed in words. dest may be one of the operands
+ * at the same position, but must not overlap them otherwise.
+ */
+static void
+opnbits(BITOP op, void *dest, size_t destpos,
+    const void *const *bits, const size_t *pos, size_t count, size_t size)
+{
+  uint8_t acc[BLOCKSIZE], buf[BLOCKSIZE], *d;
+  size_t i, n, off = 0;
+  uint64_t w;
+
+  if (count == 0) {
+    if (op == ANDOP)
+      bitfill(dest, destpos, size, 1, 1);
+    else
+      bitclear(dest, destpos, size);
+    return;
+  }
+
+  if (destpos % 8 != 0 && size > 0) {
+    off = 8 - destpos % 8;
+    if (off > size)
+      off = size;
+    w = getbits(bits[0], pos[0], off);
+    for (i = 1; i < count; i++)
+      w = calc(op, w, getbits(bits[i], pos[i], off));
+    putbits(dest, destpos, off, w);
+  }
+
+  d = (uint8_t *)dest + (destpos + off) / 8;
+  for (; size - off >= 8; off += n * 8, d += n) {
+    n = (size - off) / 8 < BLOCKSIZE ? (size - off) / 8 : BLOCKSIZE;
+    memcpy(acc, tilebytes(bits[0], pos[0] + off, n, buf), n);
+    for (i = 1; i < count; i++) {
+      kernels.binop[op](acc, acc,
+          tilebytes(bits[i], pos[i] + off, n, buf), n);
+    }
+    memcpy(d, acc, n);
+  }
+
+  if (off < size) {
+    w = getbits(bits[0], pos[0] + off, size - off);
+    for (i = 1; i < count; i++)
+      w = calc(op, w, getbits(bits[i], pos[i] + off, size - off));
+    putbits(d, 0, size - off, w);
+  }
+}
+
+void
+bitandn(void *dest, size_t destpos,
+    const void *const *bits, const size_t *pos, size_t count, size_t size)
+{
+  opnbits(ANDOP, dest, destpos, bits, pos, count, size);
+}
+
+void
+bitorn(void *dest, size_t destpos,
+    const void *const *bits, const size_t *pos, size_t count, size_t size)
+{
+  opnbits(OROP, dest, destpos, bits, pos, count, size);
+}
+
+void
+bitxorn(void *dest, size_t destpos,
+    const void *const *bits, const size_t *pos, size_t count, size_t size)
+{
+  opnbits(XOROP, dest, destpos, bits, pos, count, size);
+}
+
+#define TILEWORDS           (BLOCKSIZE / 8)
+
+/*
+ * bit-sliced counters of a tile, a word per bit of the tile at each
+ * level. The words of a level are held pending until another come,
+ * and the two are added to the level with a carry-save adder, whose
+ * carries go up to the next level in the same way.
+ */
+typedef struct {
+  int levels;
+  uint64_t (*counters)[TILEWORDS];
+  uint64_t *pending[64];  /* NULL if none */
+  uint64_t *spare[65];    /* buffers not holding words */
+  int nspare;
+} tilecounter;
+
+/* adds the words to level j and returns a spare buffer for the next */
+static uint64_t *
+tilecarry(tilecounter *tc, int j, uint64_t *words)
+{
+  uint64_t a, b, u, *p;
+  size_t i;
+
+  for (; j < tc->levels; j++) {
+    if (tc->pending[j] == NULL) {
+      tc->pending[j] = words;
+      return tc->spare[--tc->nspare];
+    }
+    p = tc->pending[j];
+    for (i = 0; i < TILEWORDS; i++) {
+      a = tc->counters[j][i];
+      b = p[i];
+      u = a ^ b;
+      tc->counters[j][i] = u ^ words[i];
+      words[i] = (a & b) | (u & words[i]);
+    }
+    tc->pending[j] = NULL;
+    tc->spare[tc->nspare++] = p;
+  }
+  return words;
+}
+
+/* adds the pending words to the counters, rippling the carries */
+static void
+tileflush(tilecounter *tc)
+{
+  uint64_t carry, *p;
+  size_t i;
+  int j, k;
+
+  for (j = 0; j < tc->levels; j++) {
+    if ((p = tc->pending[j]) == NULL)
+      continue;
+    for (k = j; k < tc->levels; k++) {
+      for (i = 0; i < TILEWORDS; i++) {
+        carry = tc->counters[k][i] & p[i];
+        tc->counters[k][i] ^= p[i];
+        p[i] = carry;
+      }
+    }
+    tc->pending[j] = NULL;
+    tc->spare[tc->nspare++] = p;
+  }
+}
+
+/*
+ * Sets the bits set in at least t of the operands. The operands are
+ * counted tile by tile in bit-sliced counters, which are compared with
+ * t from the top level. The loops run over whole tiles so that the
+ * compiler vectorizes them; the words past the bits are not used.
+ * dest may overlap the operands as in bitandn.
+ */
+void
+bitatleast(void *dest, size_t destpos, const void *const *bits,
+    const size_t *pos, size_t count, size_t size, size_t t)
+{
+  uint64_t *words, gt, eq;
+  tilecounter tc;
+  size_t i, k, n, off;
+  int j;
+
+  if (t > count) {
+    bitclear(dest, destpos, size);
+    return;
+  }
+
+  for (tc.levels = 1; tc.levels < 64 && count >> tc.levels != 0; tc.levels++)
+    ;
+  /* a buffer for each level pending and one for the words */
+  tc.counters = (uint64_t (*)[TILEWORDS])calloc((size_t)tc.levels * 2 + 1,
+      sizeof(uint64_t) * TILEWORDS);
+  for (j = 0; j < tc.levels; j++)
+    tc.pending[j] = NULL;
+  for (tc.nspare = 0; tc.nspare < tc.levels; tc.nspare++)
+    tc.spare[tc.nspare] = tc.counters[tc.levels + tc.nspare];
+  words = tc.counters[tc.levels * 2];
+
+  for (off = 0; off < size; off += n) {
+    n = size - off < BLOCKSIZE * 8 ? size - off : BLOCKSIZE * 8;
+    memset(tc.counters, 0, sizeof(tc.counters[0]) * (size_t)tc.levels);
+    for (k = 0; k < count; k++) {
+      copybits(words, 0, bits[k], pos[k] + off, n);
+      words = tilecarry(&tc, 0, words);
+    }
+    tileflush(&tc);
+
+    /* whether each count is greater than or equal to t so far */
+    for (i = 0; i < (n + 63) / 64; i++) {
+      gt = 0;
+      eq = ~(uint64_t)0;
+      for (j = tc.levels - 1; j >= 0; j--) {
+        if (t >> j & 1) {
+          eq &= tc.counters[j][i];
+        } else {
+          gt |= eq & tc.counters[j][i];
+          eq &= ~tc.counters[j][i];
+        }
+      }
+      words[i] = gt | eq;
+    }
+    copybits(dest, destpos + off, words, 0, n);
+  }
+
+  free(tc.counters);
+}
+
+size_t
+bitcount(const void *bits, size_t pos, size_t size)
+{
+  size_t n, c = 0;
+
+  if (size == 0)
+    return 0;
+
+  if (pos % 8 != 0) {
+    n = 8 - pos % 8;
+    if (n > size)
+      n = size;
+    c += (size_t)popcount64(getbits(bits, pos, n));
+    pos += n;
+    size -= n;
+  }
+  c += kernels.count((const uint8_t *)bits + pos / 8, size / 8);
+  pos += size / 8 * 8;
+  if (size % 8 != 0)
+    c += (size_t)popcount64(getbits(bits, pos, size % 8));
+  return c;
+}
+
+/*
+ * Counts the set bits of op applied to the operands without writing
+ * them. The head and tail bits are counted in words, and the body by
+ * the count kernels, realigning bits2 block by block into the stack
+ * buffer if its phase differs from bits1.
+ */
+static size_t
+countbits(BITOP op, const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  uint8_t buf[BLOCKSIZE];
+  const uint8_t *s2;
+  size_t n, c = 0;
+
+  if (size == 0)
+    return 0;
+
+  if (pos1 % 8 != 0) {
+    n = 8 - pos1 % 8;
+    if (n > size)
+      n = size;
+    c += (size_t)popcount64(calc(op, getbits(bits1, pos1, n),
+          getbits(bits2, pos2, n)));
+    pos1 += n;
+    pos2 += n;
+    size -= n;
+  }
+
+  for (; size >= 8; size -= n * 8, pos1 += n * 8, pos2 += n * 8) {
+    n = size / 8;
+    if (pos2 % 8 == 0) {
+      s2 = (const uint8_t *)bits2 + pos2 / 8;
+    } else {
+      if (n > BLOCKSIZE)
+        n = BLOCKSIZE;
+      copybits(buf, 0, bits2, pos2, n * 8);
+      s2 = buf;
+    }
+    c += kernels.countop[op]((const uint8_t *)bits1 + pos1 / 8, s2, n);
+  }
+
+  if (size > 0)
+    c += (size_t)popcount64(calc(op, getbits(bits1, pos1, size),
+          getbits(bits2, pos2, size)));
+  return c;
+}
+
+size_t
+bitandcount(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  return countbits(ANDOP, bits1, pos1, bits2, pos2, size);
+}
+
+size_t
+bitorcount(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  return countbits(OROP, bits1, pos1, bits2, pos2, size);
+}
+
+size_t
+bitxorcount(const void *bits1, size_t pos1,
+    const void *bits2, size_t pos2, size_t size)
+{
+  return countbits(XOROP, bits1, pos1, bits2, pos2, size);
+}
+
+/*
+ * Returns the offset from pos of the first bit which differs from flip,
+ * or size. Zero words are skipped 4 at a time.
+ */
+static size_t
+nextbit(const void *bits, size_t pos, size_t size, uint64_t flip)
+{
+  const uint8_t *p;
+  size_t i = 0, n;
+  uint64_t w;
+
+  if (pos % 8 != 0 && size > 0) {
+    n = 8 - pos % 8;
+    if (n > size)
+      n = size;
+    if ((w = (getbits(bits, pos, n) ^ flip) & MASK64(n)) != 0)
+      return (size_t)clz64(w << (64 - n));
+    i = n;
+  }
+
+  p = (const uint8_t *)bits + (pos + i) / 8;
+  for (; i + 256 <= size; i += 256, p += 32) {
+    if (((loadword(p) ^ flip) | (loadword(p + 8) ^ flip) |
+          (loadword(p + 16) ^ flip) | (loadword(p + 24) ^ flip)) != 0)
+      break;
+  }
+  for (; i + 64 <= size; i += 64, p += 8) {
+    if ((w = load64(p) ^ flip) != 0)
+      return i + (size_t)clz64(w);
+  }
+  if (i < size) {
+    n = size - i;
+    if ((w = (getbits(bits, pos + i, n) ^ flip) & MASK64(n)) != 0)
+      return i + (size_t)clz64(w << (64 - n));
+  }
+  return size;
+}
+
+/* Returns the offset from pos of the first set bit, or size. */
+size_t
+bitnextset(const void *bits, size_t pos, size_t size)
+{
+  return nextbit(bits, pos, size, 0);
+}
+
+/* Returns the offset from pos of the first clear bit, or size. */
+size_t
+bitnextclear(const void *bits, size_t pos, size_t size)
+{
+  return nextbit(bits, pos, size, ~(uint64_t)0);
+}
+
+/* Returns the offset from pos of the last set bit, or size. */
+size_t
+bitprevset(const void *bits, size_t pos, size_t size)
+{
+  size_t end, n;
+  uint64_t w;
+
+  for (end = size; end > 0; end -= n) {
+    /* words ending on a byte boundary where they can */
+    n = (pos + end) % 8 != 0 ? (pos + end) % 8 : 64;
+    if (n > end)
+      n = end;
+    if ((w = getbits(bits, pos + end - n, n)) != 0)
+      return end - 64 + (size_t)clz64(w & (~w + 1));
+  }
+  return size;
+}
+
+/*
+ * Writes the offsets from pos of the first set bits, at most n, and
+ * returns how many. The next call may resume from the bit after the
+ * last offset. Whole bytes go to the expand kernel while 8 more
+ * offsets fit.
+ */
+size_t
+bitnextsetn(const void *bits, size_t pos, size_t size,
+    size_t *offsets, size_t n)
+{
+  size_t i = 0, k = 0, m;
+  uint64_t w;
+  int c;
+
+  while (i < size && k < n) {
+    if ((pos + i) % 8 == 0 && size - i >= 8 && n - k >= 8) {
+      i += kernels.expand((const uint8_t *)bits + (pos + i) / 8,
+          (size - i) / 8, i, offsets, n, &k) * 8;
+      if (k + 8 <= n)
+        continue;
+    }
+    if (i >= size)
+      break;
+    m = 8 - (pos + i) % 8;
+    if (m > size - i)
+      m = size - i;
+    w = getbits(bits, pos + i, m) << (64 - m);
+    for (; w != 0 && k < n; w ^= (uint64_t)1 << (63 - c)) {
+      c = clz64(w);
+      offsets[k++] = i + (size_t)c;
+    }
+    i += m;
+  }
+  return k;
+}
+
+/*
+ * rank and select
+ *
+ * The index holds a word per group of 2048 bits: the set bits before
+ * the group since its superblock of RANKSUPER groups in the upper 32
+ * bits, and the counts of the first 3 blocks of 512 bits in 10 bits
+ * each, and the set bits before each superblock. A rank reads one
+ * index word, a base and at most a block of the bits, for an overhead
+ * of about 3%. Select starts from the group of every RANKSAMPLE'th set
+ * bit and searches the groups up to the next sample.
+ */
+
+#define RANKBLOCK           512
+#define RANKGROUP           2048
+#ifndef RANKSUPER
+#define RANKSUPER           64      /* groups per superblock */
+#endif
+#define RANKSAMPLE          8192
+
+struct bitrank {
+  const void *bits;
+  size_t pos;
+  size_t size;
+  size_t ones;
+  size_t ngroups;
+  uint64_t *bases;      /* the set bits before each superblock */
+  uint64_t *groups;
+  size_t *samples;
+};
+
+/* the set bits before group g */
+static inline size_t
+rankbase(const bitrank *r, size_t g)
+{
+  if (g == r->ngroups)
+    return r->ones;
+  return (size_t)(r->bases[g / RANKSUPER] + (r->groups[g] >> 32));
+}
+
+static inline size_t
+rankblock(const bitrank *r, size_t g, size_t b)
+{
+  return (size_t)(r->groups[g] >> (20 - 10 * b) & 0x3ff);
+}
+
+/* the set bits from the bit from, n < RANKBLOCK */
+static size_t
+rankbits(const bitrank *r, size_t from, size_t n)
+{
+  size_t c = 0;
+
+  for (; n >= 64; from += 64, n -= 64)
+    c += (size_t)popcount64(getbits(r->bits, r->pos + from, 64));
+  if (n > 0)
+    c += (size_t)popcount64(getbits(r->bits, r->pos + from, n));
+  return c;
+}
+
+/* recounts groups first to last - 1 from c set bits, returns the sum */
+static size_t
+rankcount(bitrank *r, size_t first, size_t last, size_t c)
+{
+  size_t g, b, from, n, counts[4];
+
+  for (g = first; g < last; g++) {
+    if (g % RANKSUPER == 0)
+      r->bases[g / RANKSUPER] = c;
+    for (b = 0; b < 4; b++) {
+      from = g * RANKGROUP + b * RANKBLOCK;
+      n = from >= r->size ? 0 :
+        r->size - from < RANKBLOCK ? r->size - from : RANKBLOCK;
+      counts[b] = n == 0 ? 0 : bitcount(r->bits, r->pos + from, n);
+    }
+    r->groups[g] = (uint64_t)(c - r->bases[g / RANKSUPER]) << 32 |
+      counts[0] << 20 | counts[1] << 10 | counts[2];
+    c += counts[0] + counts[1] + counts[2] + counts[3];
+  }
+  return c;
+}
+
+/* samples the set bits from the group first, searching for each */
+static void
+ranksample(bitrank *r, size_t first)
+{
+  size_t j, k, lo, hi, mid, step;
+
+  r->samples = (size_t *)realloc(r->samples, sizeof(size_t) *
+      (r->ones / RANKSAMPLE + 1));
+  lo = first;
+  j = (rankbase(r, first) + RANKSAMPLE - 1) / RANKSAMPLE;
+  for (k = j * RANKSAMPLE; k < r->ones; j++, k += RANKSAMPLE) {
+    /*
+     * the last group starting at or before the set bit, galloping from
+     * the previous one and bisecting
+     */
+    for (step = 1; lo + step < r->ngroups && rankbase(r, lo + step) <= k;
+        step *= 2)
+      lo += step;
+    hi = lo + step < r->ngroups ? lo + step - 1 : r->ngroups - 1;
+    while (lo < hi) {
+      mid = lo + (hi - lo + 1) / 2;
+      if (rankbase(r, mid) <= k)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    r->samples[j] = lo;
+  }
+}
+
+bitrank *
+bitrankmake(const void *bits, size_t pos, size_t size)
+{
+  bitrank *r;
+
+  r = (bitrank *)malloc(sizeof(bitrank));
+  r->bits = bits;
+  r->pos = pos;
+  r->size = size;
+  r->ngroups = (size + RANKGROUP - 1) / RANKGROUP;
+  r->bases = (uint64_t *)malloc(sizeof(uint64_t) *
+      (r->ngroups / RANKSUPER + 1));
+  r->bases[0] = 0;
+  r->groups = (uint64_t *)malloc(sizeof(uint64_t) * (r->ngroups + 1));
+  r->samples = NULL;
+  r->ones = rankcount(r, 0, r->ngroups, 0);
+  ranksample(r, 0);
+  return r;
+}
+
+void
+bitrankfree(bitrank *r)
+{
+  free(r->bases);
+  free(r->groups);
+  free(r->samples);
+  free(r);
+}
+
+/*
+ * Recounts the groups covering the bits changed from pos, relative to
+ * the indexed bits, and shifts the counts after them, which are not
+ * read again: the groups up to the end of their superblock and the
+ * bases of the superblocks after it. The select samples after the
+ * change are searched for again.
+ */
+void
+bitrankupdate(bitrank *r, size_t pos, size_t size)
+{
+  size_t first, last, g, s, old, c;
+  uint64_t base = 0, shift;
+
+  if (size == 0 || pos >= r->size)
+    return;
+  if (size > r->size - pos)
+    size = r->size - pos;
+
+  first = pos / RANKGROUP;
+  last = (pos + size - 1) / RANKGROUP + 1;
+  old = rankbase(r, last);
+  if (last < r->ngroups)
+    base = r->bases[last / RANKSUPER];
+  c = rankcount(r, first, last, rankbase(r, first));
+
+  if (last < r->ngroups) {
+    /* the base of the group after may have been recounted */
+    s = last / RANKSUPER;
+    if (last % RANKSUPER == 0)
+      r->bases[s] = base + (c - old);
+    shift = base + (c - old) - r->bases[s];
+    for (g = last; g < r->ngroups && g / RANKSUPER == s; g++)
+      r->groups[g] += shift << 32;
+    for (s++; s <= r->ngroups / RANKSUPER; s++)
+      r->bases[s] += c - old;
+  }
+  r->ones += c - old;
+  ranksample(r, first);
+}
+
+/* Returns the set bits before pos, relative to the indexed bits. */
+size_t
+bitrank1(const bitrank *r, size_t pos)
+{
+  size_t g, b, c;
+
+  if (pos >= r->size)
+    return r->ones;
+
+  g = pos / RANKGROUP;
+  c = rankbase(r, g);
+  for (b = 0; b < pos % RANKGROUP / RANKBLOCK; b++)
+    c += rankblock(r, g, b);
+  return c + rankbits(r, g * RANKGROUP + b * RANKBLOCK, pos % RANKBLOCK);
+}
+
+/* the k'th set bit of w from the top, which has more than k */
+static size_t
+selectword(uint64_t w, size_t k)
+{
+  size_t i = 0, c;
+
+  while (k >= (c = (size_t)popcount64(w >> 56))) {
+    k -= c;
+    w <<= 8;
+    i += 8;
+  }
+  for (;; i++, w <<= 1) {
+    if (w >> 63 && k-- == 0)
+      return i;
+  }
+}
+
+/*
+ * Returns the position of the set bit with k set bits before it,
+ * relative to the indexed bits, or the size if there are not so many.
+ */
+size_t
+bitselect1(const bitrank *r, size_t k)
+{
+  size_t lo, hi, mid, b, c, from, n;
+  uint64_t w;
+
+  if (k >= r->ones)
+    return r->size;
+
+  /* the last group starting at or before the bit */
+  lo = r->samples[k / RANKSAMPLE];
+  hi = k / RANKSAMPLE + 1 < (r->ones + RANKSAMPLE - 1) / RANKSAMPLE ?
+    r->samples[k / RANKSAMPLE + 1] : r->ngroups - 1;
+  while (lo < hi) {
+    mid = lo + (hi - lo + 1) / 2;
+    if (rankbase(r, mid) <= k)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  k -= rankbase(r, lo);
+  for (b = 0; b < 3 && k >= (c = rankblock(r, lo, b)); b++)
+    k -= c;
+  for (from = lo * RANKGROUP + b * RANKBLOCK; ; from += 64) {
+    n = r->size - from < 64 ? r->size - from : 64;
+    w = getbits(r->bits, r->pos + from, n) << (64 - n);
+    c = (size_t)popcount64(w);
+    if (k < c)
+      return from + selectword(w, k);
+    k -= c;
+  }
+}
+
+/*
+ * compressed bitmaps
+ *
+ * The bits are split into chunks of 2^16 bits, and each chunk with set
+ * bits is kept in the smallest of three forms: the sorted offsets of
+ * the set bits, the bits themselves, or the runs of set bits as pairs
+ * of the first offset and the length - 1. The operations merge the
+ * offsets and the runs directly, and the other pairs of chunks through
+ * their bits and the byte kernels. The result of a chunk is repacked in
+ * the smallest form.
+ */
+
+#define CHUNKBITS           65536
+#define CHUNKBYTES          (CHUNKBITS / 8)
+#define CHUNKARRAY          (CHUNKBYTES / 2)    /* the most offsets */
+#define CHUNKMERGE          256     /* the most offsets merged, not looked up */
+
+typedef enum CHUNKTYPE {
+  ARRAYCHUNK,
+  BITSCHUNK,
+  RUNCHUNK
+} CHUNKTYPE;
+
+typedef struct bitchunk {
+  size_t index;         /* the chunk holds the bits from index * CHUNKBITS */
+  CHUNKTYPE type;
+  size_t n;             /* the offsets or the runs */
+  size_t count;
+  void *data;
+} bitchunk;
+
+struct bitmap {
+  size_t size;
+  size_t nchunks;
+  bitchunk *chunks;     /* the chunks with set bits in order */
+};
+
+static size_t
+chunkdatasize(const bitchunk *c)
+{
+  switch (c->type) {
+  case ARRAYCHUNK:
+    return sizeof(uint16_t) * c->n;
+  case RUNCHUNK:
+    return sizeof(uint16_t) * 2 * c->n;
+  default:
+    return CHUNKBYTES;
+  }
+}
+
+static CHUNKTYPE
+chunktype(size_t count, size_t runs)
+{
+  if (runs * 4 < (count <= CHUNKARRAY ? count * 2 : CHUNKBYTES))
+    return RUNCHUNK;
+  return count <= CHUNKARRAY ? ARRAYCHUNK : BITSCHUNK;
+}
+
+/* the runs of set bits in the chunk bits */
+static size_t
+countruns(const uint8_t *bytes)
+{
+  size_t i, c = 0;
+  uint64_t w, last = 0;
+
+  for (i = 0; i < CHUNKBYTES; i += 8) {
+    w = load64(bytes + i);
+    c += (size_t)popcount64(w & ~(w >> 1 | last << 63));
+    last = w;
+  }
+  return c;
+}
+
+/* sets the set bits of the chunk bits to c in the smallest form */
+static void
+packbits(bitchunk *c, const uint8_t *bytes)
+{
+  size_t offsets[256], runs, from, i, k;
+  uint16_t *v;
+
+  c->n = 0;
+  c->count = kernels.count(bytes, CHUNKBYTES);
+  c->type = ARRAYCHUNK;
+  c->data = NULL;
+  if (c->count == 0)
+    return;
+
+  runs = countruns(bytes);
+  c->type = chunktype(c->count, runs);
+  switch (c->type) {
+  case ARRAYCHUNK:
+    c->data = v = (uint16_t *)malloc(sizeof(uint16_t) * c->count);
+    for (from = 0; (k = bitnextsetn(bytes, from, CHUNKBITS - from,
+            offsets, 256)) > 0; from += offsets[k - 1] + 1) {
+      for (i = 0; i < k; i++)
+        v[c->n++] = (uint16_t)(from + offsets[i]);
+    }
+    break;
+  case RUNCHUNK:
+    c->data = v = (uint16_t *)malloc(sizeof(uint16_t) * 2 * runs);
+    for (from = bitnextset(bytes, 0, CHUNKBITS); from < CHUNKBITS;
+        from += k + bitnextset(bytes, from + k, CHUNKBITS - from - k)) {
+      k = bitnextclear(bytes, from, CHUNKBITS - from);
+      v[c->n * 2] = (uint16_t)from;
+      v[c->n * 2 + 1] = (uint16_t)(k - 1);
+      c->n++;
+    }
+    break;
+  default:
+    c->data = malloc(CHUNKBYTES);
+    memcpy(c->data, bytes, CHUNKBYTES);
+    break;
+  }
+}
+
+/* the chunk bits, in buf unless the chunk keeps them */
+static const uint8_t *
+chunkbits(const bitchunk *c, uint8_t *buf)
+{
+  const uint16_t *v = (const uint16_t *)c->data;
+  size_t i;
+
+  if (c->type == BITSCHUNK)
+    return (const uint8_t *)c->data;
+
+  memset(buf, 0, CHUNKBYTES);
+  if (c->type == ARRAYCHUNK) {
+    for (i = 0; i < c->n; i++)
+      buf[v[i] / 8] |= 0x80 >> v[i] % 8;
+  } else {
+    for (i = 0; i < c->n; i++)
+      bitfill(buf, v[i * 2], (size_t)v[i * 2 + 1] + 1, 1, 1);
+  }
+  return buf;
+}
+
+/* sets the n sorted offsets of v to c, which takes v */
+static void
+packarray(bitchunk *c, uint16_t *v, size_t n)
+{
+  uint8_t buf[CHUNKBYTES];
+  size_t i, runs;
+
+  for (i = runs = 0; i < n; i++)
+    runs += i == 0 || v[i] != v[i - 1] + 1;
+  c->type = ARRAYCHUNK;
+  c->n = c->count = n;
+  c->data = v;
+  if (n == 0) {
+    c->data = NULL;
+  } else if (chunktype(n, runs) == ARRAYCHUNK) {
+    c->data = realloc(v, sizeof(uint16_t) * n);
+    return;
+  } else {
+    packbits(c, chunkbits(c, buf));
+  }
+  free(v);
+}
+
+/* sets the n runs of v to c, which takes v */
+static void
+packruns(bitchunk *c, uint16_t *v, size_t n)
+{
+  uint8_t buf[CHUNKBYTES];
+  size_t i;
+
+  c->type = RUNCHUNK;
+  c->n = n;
+  c->data = v;
+  for (i = c->count = 0; i < n; i++)
+    c->count += (size_t)v[i * 2 + 1] + 1;
+  if (n == 0) {
+    c->type = ARRAYCHUNK;
+    c->data = NULL;
+  } else if (chunktype(c->count, n) == RUNCHUNK) {
+    c->data = realloc(v, sizeof(uint16_t) * 2 * n);
+    return;
+  } else {
+    packbits(c, chunkbits(c, buf));
+  }
+  free(v);
+}
+
+static bool
+chunkget(const bitchunk *c, size_t offset)
+{
+  const uint16_t *v = (const uint16_t *)c->data;
+  size_t lo = 0, hi = c->n, mid;
+
+  switch (c->type) {
+  case BITSCHUNK:
+    return ((const uint8_t *)c->data)[offset / 8] >> (7 - offset % 8) & 1;
+  case ARRAYCHUNK:
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (v[mid] < offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo < c->n && v[lo] == offset;
+  default:
+    /* the run after the last one starting at or before the offset */
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (v[mid * 2] <= offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo > 0 && offset <= (size_t)v[lo * 2 - 2] + v[lo * 2 - 1];
+  }
+}
+
+static size_t
+mergearrays(BITOP op, const uint16_t *a, size_t na,
+    const uint16_t *b, size_t nb, uint16_t *out)
+{
+  size_t i = 0, j = 0, k = 0;
+
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      if (op != ANDOP)
+        out[k++] = a[i];
+      i++;
+    } else if (a[i] > b[j]) {
+      if (op == OROP || op == XOROP)
+        out[k++] = b[j];
+      j++;
+    } else {
+      if (op == ANDOP || op == OROP)
+        out[k++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  for (; i < na && op != ANDOP; i++)
+    out[k++] = a[i];
+  for (; j < nb && (op == OROP || op == XOROP); j++)
+    out[k++] = b[j];
+  return k;
+}
+
+/* the i'th edge of the runs, which is a start if i is even, else an end */
+static inline size_t
+runedge(const uint16_t *v, size_t i)
+{
+  return i % 2 == 0 ? v[i] : (size_t)v[i - 1] + v[i] + 1;
+}
+
+/* merges the edges of the runs, keeping where op holds between them */
+static size_t
+mergeruns(BITOP op, const uint16_t *a, size_t na,
+    const uint16_t *b, size_t nb, uint16_t *out)
+{
+  size_t i = 0, j = 0, k = 0, x, start = 0;
+  bool in = false, now;
+
+  while (i < na * 2 || j < nb * 2) {
+    if (j == nb * 2 || (i < na * 2 && runedge(a, i) < runedge(b, j)))
+      x = runedge(a, i);
+    else
+      x = runedge(b, j);
+    if (i < na * 2 && runedge(a, i) == x)
+      i++;
+    if (j < nb * 2 && runedge(b, j) == x)
+      j++;
+
+    /* inside a run while past its start edge */
+    now = calc(op, i % 2, j % 2) & 1;
+    if (now && !in) {
+      start = x;
+    } else if (!now && in) {
+      out[k * 2] = (uint16_t)start;
+      out[k * 2 + 1] = (uint16_t)(x - start - 1);
+      k++;
+    }
+    in = now;
+  }
+  return k;
+}
+
+static void
+chunkop(BITOP op, const bitchunk *a, const bitchunk *b, bitchunk *c)
+{
+  uint8_t buf1[CHUNKBYTES], buf2[CHUNKBYTES];
+  const uint16_t *u = (const uint16_t *)a->data;
+  const uint8_t *s1, *s2;
+  uint16_t *v;
+  size_t i, n, flip;
+
+  if (a->type == ARRAYCHUNK && b->type == ARRAYCHUNK &&
+      a->n + b->n <= (op == OROP || op == XOROP ? CHUNKARRAY : CHUNKMERGE)) {
+    v = (uint16_t *)malloc(sizeof(uint16_t) * (a->n + b->n));
+    packarray(c, v, mergearrays(op, u, a->n,
+          (const uint16_t *)b->data, b->n, v));
+  } else if (a->type == RUNCHUNK && b->type == RUNCHUNK) {
+    v = (uint16_t *)malloc(sizeof(uint16_t) * 2 * (a->n + b->n));
+    packruns(c, v, mergeruns(op, u, a->n,
+          (const uint16_t *)b->data, b->n, v));
+  } else if (a->type == ARRAYCHUNK && (op == ANDOP || op == ANDNOTOP)) {
+    /* keeps the offsets by the bits of b without branches */
+    s2 = chunkbits(b, buf2);
+    flip = op == ANDNOTOP;
+    v = (uint16_t *)malloc(sizeof(uint16_t) * a->n);
+    for (i = n = 0; i < a->n; i++) {
+      v[n] = u[i];
+      n += (s2[u[i] / 8] >> (7 - u[i] % 8) & 1) ^ flip;
+    }
+    packarray(c, v, n);
+  } else if (b->type == ARRAYCHUNK && op == ANDOP) {
+    chunkop(op, b, a, c);
+  } else {
+    s1 = chunkbits(a, buf1);
+    s2 = chunkbits(b, buf2);
+    if (op == ANDNOTOP) {
+      kernels.notop(buf2, s2, CHUNKBYTES);
+      s2 = buf2;
+      op = ANDOP;
+    }
+    kernels.binop[op](buf1, s1, s2, CHUNKBYTES);
+    packbits(c, buf1);
+  }
+}
+
+static size_t
+chunkandcount(const bitchunk *a, const bitchunk *b)
+{
+  const uint16_t *u = (const uint16_t *)a->data;
+  const uint16_t *v = (const uint16_t *)b->data;
+  uint16_t buf[CHUNKMERGE];
+  uint8_t bits[CHUNKBYTES];
+  const uint8_t *s;
+  size_t i, j, c = 0, start, end;
+
+  if ((a->type != ARRAYCHUNK && b->type == ARRAYCHUNK) ||
+      (a->type == BITSCHUNK && b->type == RUNCHUNK))
+    return chunkandcount(b, a);
+
+  if (a->type == ARRAYCHUNK && b->type == ARRAYCHUNK &&
+      a->n + b->n <= CHUNKMERGE) {
+    c = mergearrays(ANDOP, u, a->n, v, b->n, buf);
+  } else if (a->type == ARRAYCHUNK) {
+    s = chunkbits(b, bits);
+    for (i = 0; i < a->n; i++)
+      c += s[u[i] / 8] >> (7 - u[i] % 8) & 1;
+  } else if (b->type == RUNCHUNK) {
+    for (i = j = 0; i < a->n && j < b->n; ) {
+      start = u[i * 2] > v[j * 2] ? u[i * 2] : v[j * 2];
+      end = runedge(u, i * 2 + 1) < runedge(v, j * 2 + 1) ?
+        runedge(u, i * 2 + 1) : runedge(v, j * 2 + 1);
+      if (start < end)
+        c += end - start;
+      if (runedge(u, i * 2 + 1) < runedge(v, j * 2 + 1))
+        i++;
+      else
+        j++;
+    }
+  } else if (a->type == RUNCHUNK) {
+    for (i = 0; i < a->n; i++)
+      c += bitcount(b->data, u[i * 2], (size_t)u[i * 2 + 1] + 1);
+  } else {
+    c = kernels.countop[ANDOP]((const uint8_t *)a->data,
+        (const uint8_t *)b->data, CHUNKBYTES);
+  }
+  return c;
+}
+
+bitmap *
+bitmapmake(const void *bits, size_t pos, size_t size)
+{
+  uint8_t buf[CHUNKBYTES];
+  bitmap *m;
+  size_t i, n, nchunks;
+
+  nchunks = (size + CHUNKBITS - 1) / CHUNKBITS;
+  m = (bitmap *)malloc(sizeof(bitmap));
+  m->size = size;
+  m->nchunks = 0;
+  m->chunks = (bitchunk *)malloc(sizeof(bitchunk) * (nchunks + 1));
+  for (i = 0; i < nchunks; i++) {
+    n = size - i * CHUNKBITS < CHUNKBITS ? size - i * CHUNKBITS : CHUNKBITS;
+    if (bitnextset(bits, pos + i * CHUNKBITS, n) == n)
+      continue;
+    if (n < CHUNKBITS)
+      memset(buf, 0, CHUNKBYTES);
+    copybits(buf, 0, bits, pos + i * CHUNKBITS, n);
+    packbits(&m->chunks[m->nchunks], buf);
+    m->chunks[m->nchunks++].index = i;
+  }
+  m->chunks = (bitchunk *)realloc(m->chunks,
+      sizeof(bitchunk) * (m->nchunks + 1));
+  return m;
+}
+
+void
+bitmapfree(bitmap *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->nchunks; i++)
+    free(m->chunks[i].data);
+  free(m->chunks);
+  free(m);
+}
+
+size_t
+bitmapsize(const bitmap *m)
+{
+  return m->size;
+}
+
+/* Returns the bytes the bitmap takes. */
+size_t
+bitmapbytes(const bitmap *m)
+{
+  size_t i, n;
+
+  n = sizeof(bitmap) + sizeof(bitchunk) * m->nchunks;
+  for (i = 0; i < m->nchunks; i++)
+    n += chunkdatasize(&m->chunks[i]);
+  return n;
+}
+
+bool
+bitmapget(const bitmap *m, size_t pos)
+{
+  size_t lo = 0, hi = m->nchunks, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (m->chunks[mid].index < pos / CHUNKBITS)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return pos < m->size && lo < m->nchunks &&
+    m->chunks[lo].index == pos / CHUNKBITS &&
+    chunkget(&m->chunks[lo], pos % CHUNKBITS);
+}
+
+/* Writes the bits of the bitmap to dest. */
+void
+bitmapcopy(void *dest, size_t destpos, const bitmap *m)
+{
+  const bitchunk *c;
+  const uint16_t *v;
+  size_t i, j, base, n;
+
+  bitclear(dest, destpos, m->size);
+  for (i = 0; i < m->nchunks; i++) {
+    c = &m->chunks[i];
+    v = (const uint16_t *)c->data;
+    base = c->index * CHUNKBITS;
+    switch (c->type) {
+    case ARRAYCHUNK:
+      for (j = 0; j < c->n; j++)
+        bitset(dest, destpos + base + v[j], true);
+      break;
+    case RUNCHUNK:
+      for (j = 0; j < c->n; j++) {
+        bitfill(dest, destpos + base + v[j * 2],
+            (size_t)v[j * 2 + 1] + 1, 1, 1);
+      }
+      break;
+    default:
+      n = m->size - base < CHUNKBITS ? m->size - base : CHUNKBITS;
+      bitcpy(dest, destpos + base, c->data, 0, n);
+      break;
+    }
+  }
+}
+
+static void
+copychunk(bitchunk *dest, const bitchunk *src)
+{
+  *dest = *src;
+  dest->data = malloc(chunkdatasize(src));
+  memcpy(dest->data, src->data, chunkdatasize(src));
+}
+
+/*
+ * Applies op to the chunks of the same index, and copies the chunks
+ * without a pair which op keeps.
+ */
+static bitmap *
+mapop(BITOP op, const bitmap *m1, const bitmap *m2)
+{
+  const bitchunk *a, *b;
+  bitmap *m;
+  size_t i = 0, j = 0, n = 0;
+
+  m = (bitmap *)malloc(sizeof(bitmap));
+  m->size = m1->size > m2->size ? m1->size : m2->size;
+  m->chunks = (bitchunk *)malloc(sizeof(bitchunk) *
+      (m1->nchunks + m2->nchunks + 1));
+  while (i < m1->nchunks || j < m2->nchunks) {
+    a = i < m1->nchunks ? &m1->chunks[i] : NULL;
+    b = j < m2->nchunks ? &m2->chunks[j] : NULL;
+    if (b == NULL || (a != NULL && a->index < b->index)) {
+      if (op != ANDOP)
+        copychunk(&m->chunks[n++], a);
+      i++;
+    } else if (a == NULL || b->index < a->index) {
+      if (op == OROP || op == XOROP)
+        copychunk(&m->chunks[n++], b);
+      j++;
+    } else {
+      chunkop(op, a, b, &m->chunks[n]);
+      m->chunks[n].index = a->index;
+      if (m->chunks[n].count > 0)
+        n++;
+      i++;
+      j++;
+    }
+  }
+  m->nchunks = n;
+  m->chunks = (bitchunk *)realloc(m->chunks, sizeof(bitchunk) * (n + 1));
+  return m;
+}
+
+bitmap *
+bitmapand(const bitmap *m1, const bitmap *m2)
+{
+  return mapop(ANDOP, m1, m2);
+}
+
+bitmap *
+bitmapor(const bitmap *m1, const bitmap *m2)
+{
+  return mapop(OROP, m1, m2);
+}
+
+bitmap *
+bitmapxor(const bitmap *m1, const bitmap *m2)
+{
+  return mapop(XOROP, m1, m2);
+}
+
+bitmap *
+bitmapandnot(const bitmap *m1, const bitmap *m2)
+{
+  return mapop(ANDNOTOP, m1, m2);
+}
+
+size_t
+bitmapcount(const bitmap *m)
+{
+  size_t i, c = 0;
+
+  for (i = 0; i < m->nchunks; i++)
+    c += m->chunks[i].count;
+  return c;
+}
+
+/* the others count from the set bits of both */
+size_t
+bitmapandcount(const bitmap *m1, const bitmap *m2)
+{
+  size_t i = 0, j = 0, c = 0;
+
+  while (i < m1->nchunks && j < m2->nchunks) {
+    if (m1->chunks[i].index < m2->chunks[j].index) {
+      i++;
+    } else if (m1->chunks[i].index > m2->chunks[j].index) {
+      j++;
+    } else {
+      c += chunkandcount(&m1->chunks[i], &m2->chunks[j]);
+      i++;
+      j++;
+    }
+  }
+  return c;
+}
+
+size_t
+bitmaporcount(const bitmap *m1, const bitmap *m2)
+{
+  return bitmapcount(m1) + bitmapcount(m2) - bitmapandcount(m1, m2);
+}
+
+size_t
+bitmapxorcount(const bitmap *m1, const bitmap *m2)
+{
+  return bitmapcount(m1) + bitmapcount(m2) - 2 * bitmapandcount(m1, m2);
+}
+
+size_t
+bitmapandnotcount(const bitmap *m1, const bitmap *m2)
+{
+  return bitmapcount(m1) - bitmapandcount(m1, m2);
+}
+
+/*
+ * Writes the bits in reverse order. The head and tail bits go through
+ * the byte table, and the body through the byte kernel, staging the
+ * source in the stack buffer if its end is not byte aligned. The ranges
+ * must not overlap.
+ */
+static void
+revcopybits(void *dest, size_t destpos,
+    const void *src, size_t srcpos, size_t size)
+{
+  uint8_t buf[BLOCKSIZE], *d;
+  const uint8_t *s;
+  size_t n, end;
+
+  end = srcpos + size;
+  if (destpos % 8 != 0) {
+    n = 8 - destpos % 8;
+    if (n > size)
+      n = size;
+    putbits(dest, destpos, n, REVBITS(getbits(src, end - n, n), n));
+    destpos += n;
+    end -= n;
+    size -= n;
+  }
+
+  d = (uint8_t *)dest + destpos / 8;
+  for (; size >= 8; size -= n * 8, end -= n * 8, d += n) {
+    n = size / 8;
+    if (end % 8 == 0) {
+      s = (const uint8_t *)src + end / 8 - n;
+    } else {
+      if (n > BLOCKSIZE)
+        n = BLOCKSIZE;
+      copybits(buf, 0, src, end - n * 8, n * 8);
+      s = buf;
+    }
+    kernels.revop(d, s, n);
+  }
+
+  if (size > 0)
+    putbits(d, 0, size, REVBITS(getbits(src, end - size, size), size));
+}
+
+/* reverses the bits in place, swapping blocks from both ends */
+static void
+reversebits(void *bits, size_t pos, size_t size)
+{
+  uint8_t buf[BLOCKSIZE * 2];
+  size_t n = BLOCKSIZE * 8;
+
+  for (; size >= n * 2; pos += n, size -= n * 2) {
+    copybits(buf, 0, bits, pos, n);
+    copybits(buf, n, bits, pos + size - n, n);
+    revcopybits(bits, pos, buf, n, n);
+    revcopybits(bits, pos + size - n, buf, 0, n);
+  }
+  copybits(buf, 0, bits, pos, size);
+  revcopybits(bits, pos, buf, 0, size);
+}
+
+void
+bitreverse(void *dest, size_t destpos,
+    const void *src, size_t srcpos, size_t size)
+{
+  if (overlap(dest, destpos, src, srcpos, size) == OVERLAP_NONE) {
+    revcopybits(dest, destpos, src, srcpos, size);
+  } else {
+    bitcpy(dest, destpos, src, srcpos, size);
+    reversebits(dest, destpos, size);
+  }
+}
+
+/*
+ * format
+ *
+ *   format  := { ' ' | param }
+ *   param   := [literal] '%' type [order] ['@' pos] [':' bits]
+ *   literal := ['-'] digits                  integer
+ *            | ['-'] digits '#' alnums       integer in base 2-36
+ *            | ['-'] [digits] '.' digits     float
+ *            | "'" char "'"                  character code
+ *            | '"' chars '"' | '|' chars '|' string
+ *   type    := c C s S i I l L q Q f d ^ a A #
+ *   order   := '=' (native) | '<' (little) | '>' '!' (big)
+ *   pos     := digits | '?' | '^' | '+'
+ *   bits    := digits | '?' | '^'
+ *
+ * A param without a position is placed at the cursor, which follows
+ * the previous param ('+' says so explicitly). A number is a position
+ * from the origin. '?' takes the position or the number of bits from a
+ * size_t argument, and '^' stores the one used to a size_t * argument.
+ * The arguments of a param are taken in the order: position, bits,
+ * value. The number of bits defaults to the size of the type.
+ *
+ * Byte order applies to fields of whole bytes only. A literal is
+ * written instead of an argument value, and must match when scanning.
+ */
+char *
+bitcompilef(const char *format, size_t *size)
+{
+  const char *s, *str = NULL;
+  uint8_t *code = NULL, *wcode = NULL;
+  bool build = false, neg;
+  size_t codesize, nparams, posval = 0, nbitsval = 0, strsize = 0;
+  size_t ndigits;
+  uint8_t valtype, spcr = 0, ordertype = 0, postype = 0, nbitstype = 0;
+  unsigned long base, v, uintval = 0;
+  long intval = 0;
+  double floatval = 0;
+  char quote;
+
+parse:
+  /* magic + code size + nparams */
+  codesize = 1 + sizeof(size_t) * 2;
+  nparams = 0;
+
+  s = format;
+  while (*s != '\0') {
+    valtype = VALUE_NULL;
+    switch (*s) {
+    case ' ':
+      s++;
+      continue;
+
+    case '%':
+      break;
+
+    case '\'':
+      /* character */
+      if (s[1] == '\0' || s[2] != '\'')
+        goto error;
+      valtype = VALUE_UINT;
+      uintval = (unsigned char)s[1];
+      s += 3;
+      break;
+
+    case '"': case '|':
+      /* string */
+      quote = *s++;
+      str = s;
+      while (*s != quote) {
+        if (*s == '\0')
+          goto error;
+        s++;
+      }
+      strsize = (size_t)(s - str);
+      valtype = VALUE_STR;
+      s++;
+      break;
+
+    case '.': case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      /* int, float literals */
+      str = s;
+      neg = false;
+      if (*s == '-') {
+        neg = true;
+        s++;
+      }
+
+      /* for xx#xxxx */
+      base = 0;
+      ndigits = 0;
+      while (isdigit((unsigned char)*s)) {
+        base = (base * 10) + (*s - '0');
+        ndigits++;
+        s++;
+      }
+
+      if (*s == '#') {
+        if (ndigits == 0 || base < 2 || base > 36)
+          goto error;
+        s++; /* # */
+        ndigits = 0;
+        uintval = 0;
+        while (isalnum((unsigned char)*s)) {
+          if (isdigit((unsigned char)*s))
+            v = *s - '0';
+          else if (isupper((unsigned char)*s))
+            v = *s - 'A' + 10;
+          else
+            v = *s - 'a' + 10;
+          if (v >= base)
+            goto error;
+          uintval = (uintval * base) + v;
+          ndigits++;
+          s++;
+        }
+      } else if (*s == '.') {
+        if (!isdigit((unsigned char)s[1]))
+          goto error;
+        valtype = VALUE_FLOAT;
+        floatval = strtod(str, (char **)&s);
+        break;
+      } else {
+        uintval = base;
+      }
+
+      if (ndigits == 0)
+        goto error;
+      if (neg) {
+        valtype = VALUE_INT;
+        intval = -(long)uintval;
+      } else {
+        valtype = VALUE_UINT;
+      }
+      break;
+
+    default:
+      goto error;
+    }
+
+    codesize += 1; /* value_type */
+    switch (valtype) {
+    case VALUE_INT:
+      codesize += sizeof(long);
+      break;
+    case VALUE_UINT:
+      codesize += sizeof(unsigned long);
+      break;
+    case VALUE_FLOAT:
+      codesize += sizeof(double);
+      break;
+    case VALUE_STR:
+      codesize += sizeof(size_t) + strsize;
+      break;
+    }
+
+    /* parse type specifier */
+    if (*s != '%') {
+      goto error;
+    } else {
+      s++; /* '%' */
+      nparams++;
+      codesize += 4; /* type_specifier, byte_order, pos, nbits */
+
+      switch (*s) {
+      case 'c':
+        spcr = TYPE_CHAR;
+        break;
+      case 'C':
+        spcr = TYPE_UCHAR;
+        break;
+      case 's':
+        spcr = TYPE_SHORT;
+        break;
+      case 'S':
+        spcr = TYPE_USHORT;
+        break;
+      case 'i':
+        spcr = TYPE_INT;
+        break;
+      case 'I':
+        spcr = TYPE_UINT;
+        break;
+      case 'l':
+        spcr = TYPE_LONG;
+        break;
+      case 'L':
+        spcr = TYPE_ULONG;
+        break;
+      case 'q':
+        spcr = TYPE_LLONG;
+        break;
+      case 'Q':
+        spcr = TYPE_ULLONG;
+        break;
+      case 'f':
+        spcr = TYPE_FLOAT;
+        break;
+      case 'd':
+        spcr = TYPE_DOUBLE;
+        break;
+      case '^':
+        spcr = TYPE_PTR;
+        break;
+      case 'a':
+        spcr = TYPE_STR_NULL;
+        break;
+      case 'A':
+        spcr = TYPE_STR_NONNULL;
+        break;
+      case '#':
+        spcr = TYPE_IGNORE;
+        break;
+      default:
+        goto error;
+      }
+      s++; /* type specifier */
+
+      /* byte order */
+      switch (*s) {
+      case '=':
+        ordertype = ENDIAN_NATIVE;
+        s++;
+        break;
+      case '>': case '!':
+        ordertype = ENDIAN_BIG;
+        s++;
+        break;
+      case '<':
+        ordertype = ENDIAN_LITTLE;
+        s++;
+        break;
+      default:
+        ordertype = ENDIAN_NATIVE;
+        break;
+      }
+
+      /* pos */
+      postype = POS_NULL;
+      if (*s == '@') {
+        s++;
+        switch (*s) {
+        case '?':
+          postype = POS_VAR;
+          s++;
+          break;
+        case '^':
+          postype = POS_PTR;
+          s++;
+          break;
+        case '+':
+          postype = POS_CUR;
+          s++;
+          break;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+          postype = POS_VALUE;
+          posval = *s - '0';
+          s++;
+          while (isdigit((unsigned char)*s)) {
+            posval = (posval * 10) + (*s - '0');
+            s++;
+          }
+          codesize += sizeof(size_t);
+          break;
+        default:
+          goto error;
+        }
+      }
+
+      /* bits */
+      nbitstype = NBITS_NULL;
+      if (*s == ':') {
+        s++;
+        switch (*s) {
+        case '?':
+          nbitstype = NBITS_VAR;
+          s++;
+          break;
+        case '^':
+          nbitstype = NBITS_PTR;
+          s++;
+          break;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+          nbitstype = NBITS_VALUE;
+          nbitsval = *s - '0';
+          s++;
+          while (isdigit((unsigned char)*s)) {
+            nbitsval = (nbitsval * 10) + (*s - '0');
+            s++;
+          }
+          codesize += sizeof(size_t);
+          break;
+        default:
+          goto error;
+        }
+      }
+    }
+
+    if (build) {
+      *wcode++ = valtype;
+      switch (valtype) {
+      case VALUE_INT:
+        memcpy(wcode, &intval, sizeof(long));
+        wcode += sizeof(long);
+        break;
+
+      case VALUE_UINT:
+        memcpy(wcode, &uintval, sizeof(unsigned long));
+        wcode += sizeof(unsigned long);
+        break;
+
+      case VALUE_FLOAT:
+        memcpy(wcode, &floatval, sizeof(double));
+        wcode += sizeof(double);
+        break;
+
+      case VALUE_STR:
+        memcpy(wcode, &strsize, sizeof(size_t));
+        wcode += sizeof(size_t);
+        memcpy(wcode, str, strsize);
+        wcode += strsize;
+        break;
+      }
+
+      /* type specifier */
+      *wcode++ = spcr;
+
+      /* byte order */
+      *wcode++ = ordertype;
+
+      /* pos */
+      *wcode++ = postype;
+      if (postype == POS_VALUE) {
+        memcpy(wcode, &posval, sizeof(size_t));
+        wcode += sizeof(size_t);
+      }
+
+      /* bits */
+      *wcode++ = nbitstype;
+      if (nbitstype == NBITS_VALUE) {
+        memcpy(wcode, &nbitsval, sizeof(size_t));
+        wcode += sizeof(size_t);
+      }
+    }
+  }
+
+  if (!build) {
+    build = true;
+    code = wcode = (uint8_t *)malloc(codesize);
+    *wcode++ = MAGIC;
+    wcode += sizeof(size_t) * 2; /* size, nparams */
+    goto parse;
+  }
+  memcpy(code + 1, &codesize, sizeof(size_t));
+  memcpy(code + 1 + sizeof(size_t), &nparams, sizeof(size_t));
+  if (size != NULL)
+    *size = codesize;
+  return (char *)code;
+
+error:
+  if (build)
+    free(code);
+  return NULL;
+}
+
+/*
+ * format VM
+ *
+ * Runs compiled format code against the bits. The params are decoded
+ * from the code in order; fields of fixed position and size are read
+ * and written as words.
+ */
+
+typedef struct param {
+  uint8_t valtype;
+  union {
+    long intval;
+    unsigned long uintval;
+    double floatval;
+    struct {
+      size_t size;
+      const char *s;
+    } strval;
+  } value;
+  uint8_t spcr;
+  uint8_t order;
+  uint8_t postype;
+  uint8_t nbitstype;
+  size_t pos;
+  size_t nbits;
+} param;
+
+/*
+ * stream reader
+ *
+ * Holds a window of the stream in a buffer, refilled with block reads
+ * as fields move forward. The bytes before a field are only dropped
+ * when the buffer has no room, so that fields may go back in a record
+ * while they are in the buffer. A bytewise reader never reads past the
+ * bytes the fields need, and keeps all of them.
+ */
+
+#define READERSIZE          65536
+
+struct bitreader {
+  FILE *fp;
+  uint8_t *buf;
+  size_t capa;
+  size_t len;
+  size_t start;         /* stream offset of buf[0] in bytes */
+  size_t pos;           /* cursor in bits */
+  bool bytewise;
+};
+
+/* makes the stream bytes from..to available */
+static bool
+readerfill(bitreader *r, size_t from, size_t to)
+{
+  size_t n, skip;
+  int c;
+
+  if (to <= r->start + r->len)
+    return true;
+  if (from < r->start)
+    return false;
+
+  if (!r->bytewise && to - r->start > r->capa) {
+    if (from >= r->start + r->len) {
+      skip = from - r->start - r->len;
+      r->start += r->len;
+      r->len = 0;
+      for (; skip > 0; skip -= n, r->start += n) {
+        if ((n = fread(r->buf, 1, skip < r->capa ? skip : r->capa,
+                r->fp)) == 0)
+          return false;
+      }
+    } else {
+      memmove(r->buf, r->buf + (from - r->start), r->start + r->len - from);
+      r->len -= from - r->start;
+      r->start = from;
+    }
+  }
+
+  if (to - r->start > r->capa) {
+    r->capa = to - r->start;
+    r->buf = (uint8_t *)realloc(r->buf, r->capa);
+  }
+
+  while (r->start + r->len < to) {
+    if (r->bytewise) {
+      if ((c = getc(r->fp)) == EOF)
+        return false;
+      r->buf[r->len++] = (uint8_t)c;
+    } else {
+      if ((n = fread(r->buf + r->len, 1, r->capa - r->len, r->fp)) == 0)
+        return false;
+      r->len += n;
+    }
+  }
+  return true;
+}
+
+bitreader *
+bitreaderopen(FILE *fp, size_t bufsize)
+{
+  bitreader *r;
+
+  r = (bitreader *)malloc(sizeof(bitreader));
+  r->fp = fp;
+  r->capa = bufsize > 0 ? bufsize : READERSIZE;
+  r->buf = (uint8_t *)malloc(r->capa);
+  r->len = 0;
+  r->start = 0;
+  r->pos = 0;
+  r->bytewise = false;
+  return r;
+}
+
+void
+bitreaderclose(bitreader *r)
+{
+  free(r->buf);
+  free(r);
+}
+
+size_t
+bitreadertell(const bitreader *r)
+{
+  return r->pos;
+}
+
+/*
+ * stream writer
+ *
+ * Accumulates bits in a buffer and writes whole bytes to the file
+ * descriptor only when the buffer is full, or on an explicit flush.
+ * The bytes of a field are final once written out, so fields may only
+ * go back while their bytes are buffered. A long byte aligned string
+ * is written together with the buffer by writev, without a copy.
+ *
+ * A writer on a FILE keeps a whole record and writes it with fwrite.
+ */
+
+#define WRITERSIZE          65536
+
+struct bitwriter {
+  int fd;
+  FILE *fp;
+  uint8_t *buf;
+  size_t capa;
+  size_t len;
+  size_t start;         /* stream offset of buf[0] in bytes */
+  size_t pos;           /* cursor in bits */
+  size_t end;           /* end of the bits written */
+  bool keep;            /* never writes out before the end */
+  bool error;
+};
+
+static bool
+writeall(bitwriter *w, struct iovec *iov, int n)
+{
+  ssize_t k;
+  int i;
+
+  if (w->error)
+    return false;
+  if (w->fp != NULL) {
+    for (i = 0; i < n; i++) {
+      if (fwrite(iov[i].iov_base, 1, iov[i].iov_len, w->fp) != iov[i].iov_len)
+        return !(w->error = true);
+    }
+    return true;
+  }
+
+  while (n > 0) {
+    if ((k = writev(w->fd, iov, n)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return !(w->error = true);
+    }
+    for (; n > 0 && (size_t)k >= iov->iov_len; n--, iov++)
+      k -= iov->iov_len;
+    if (n > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + k;
+      iov->iov_len -= k;
+    }
+  }
+  return true;
+}
+
+/* writes out the first n bytes of the buffer */
+static bool
+writerout(bitwriter *w, size_t n)
+{
+  struct iovec iov;
+
+  if (n == 0)
+    return true;
+  iov.iov_base = w->buf;
+  iov.iov_len = n;
+  if (!writeall(w, &iov, 1))
+    return false;
+  memmove(w->buf, w->buf + n, w->len - n);
+  w->len -= n;
+  w->start += n;
+  return true;
+}
+
+/* makes the stream bytes from..to writable */
+static bool
+writerfill(bitwriter *w, size_t from, size_t to)
+{
+  size_t n;
+
+  if (from < w->start || w->error)
+    return false;
+
+  if (!w->keep && to - w->start > w->capa) {
+    n = from - w->start < w->len ? from - w->start : w->len;
+    if (!writerout(w, n))
+      return false;
+
+    /* bytes skipped over are zeros */
+    while (w->start < from) {
+      n = from - w->start - w->len;
+      if (n > w->capa - w->len)
+        n = w->capa - w->len;
+      memset(w->buf + w->len, 0, n);
+      w->len += n;
+      if (!writerout(w, w->len))
+        return false;
+    }
+  }
+
+  if (to - w->start > w->capa) {
+    w->capa = to - w->start;
+    w->buf = (uint8_t *)realloc(w->buf, w->capa);
+  }
+  if (to - w->start > w->len) {
+    memset(w->buf + w->len, 0, to - w->start - w->len);
+    w->len = to - w->start;
+  }
+  return true;
+}
+
+/* writes a long byte aligned string after the buffer */
+static bool
+writerdirect(bitwriter *w, size_t pos, size_t nbits, const void *s)
+{
+  struct iovec iov[2];
+
+  if (w->keep || pos % 8 != 0 || nbits % 8 != 0 || nbits / 8 < w->capa ||
+      pos / 8 != w->start + w->len || pos < w->end)
+    return false;
+
+  iov[0].iov_base = w->buf;
+  iov[0].iov_len = w->len;
+  iov[1].iov_base = (void *)s;
+  iov[1].iov_len = nbits / 8;
+  if (!writeall(w, iov, 2))
+    return false;
+  w->start += w->len + nbits / 8;
+  w->len = 0;
+  return true;
+}
+
+static bitwriter *
+newwriter(int fd, FILE *fp, size_t bufsize)
+{
+  bitwriter *w;
+
+  w = (bitwriter *)malloc(sizeof(bitwriter));
+  w->fd = fd;
+  w->fp = fp;
+  w->capa = bufsize > 0 ? bufsize : WRITERSIZE;
+  w->buf = (uint8_t *)malloc(w->capa);
+  w->len = 0;
+  w->start = 0;
+  w->pos = 0;
+  w->end = 0;
+  w->keep = false;
+  w->error = false;
+  return w;
+}
+
+bitwriter *
+bitwriteropen(int fd, size_t bufsize)
+{
+  return newwriter(fd, NULL, bufsize);
+}
+
+/* writes out the bytes before the cursor */
+bool
+bitwriterflush(bitwriter *w)
+{
+  if (w->pos / 8 > w->start)
+    writerout(w, w->pos / 8 - w->start < w->len ?
+        w->pos / 8 - w->start : w->len);
+  return !w->error;
+}
+
+/* pads the last byte with zeros, and writes out everything */
+bool
+bitwriterpad(bitwriter *w)
+{
+  size_t end;
+
+  end = (w->pos > w->end ? w->pos : w->end);
+  end = (end + 7) / 8;
+  if (writerfill(w, end, end))
+    writerout(w, w->len);
+  w->pos = w->end = end * 8;
+  return !w->error;
+}
+
+bool
+bitwriterclose(bitwriter *w)
+{
+  bool ok;
+
+  ok = bitwriterpad(w);
+  free(w->buf);
+  free(w);
+  return ok;
+}
+
+size_t
+bitwritertell(const bitwriter *w)
+{
+  return w->pos;
+}
+
+/*
+ * bits that the VM runs against, in memory or on a stream; positions
+ * are relative to base
+ */
+typedef struct bitio {
+  uint8_t *bits;
+  size_t base;
+  bitreader *reader;
+  bitwriter *writer;
+  size_t cur;           /* cursor after the run */
+} bitio;
+
+static size_t
+codesize(const uint8_t **pc)
+{
+  size_t v;
+
+  memcpy(&v, *pc, sizeof(size_t));
+  *pc += sizeof(size_t);
+  return v;
+}
+
+/* returns the first param, or NULL if the code is broken */
+static const uint8_t *
+codebegin(const char *code, size_t *nparams)
+{
+  const uint8_t *pc;
+
+  pc = (const uint8_t *)code;
+  if (pc == NULL || *pc++ != MAGIC)
+    return NULL;
+  codesize(&pc);
+  *nparams = codesize(&pc);
+  return pc;
+}
+
+static const uint8_t *
+decodeparam(const uint8_t *pc, param *p)
+{
+  p->valtype = *pc++;
+  switch (p->valtype) {
+  case VALUE_INT:
+    memcpy(&p->value.intval, pc, sizeof(long));
+    pc += sizeof(long);
+    break;
+  case VALUE_UINT:
+    memcpy(&p->value.uintval, pc, sizeof(unsigned long));
+    pc += sizeof(unsigned long);
+    break;
+  case VALUE_FLOAT:
+    memcpy(&p->value.floatval, pc, sizeof(double));
+    pc += sizeof(double);
+    break;
+  case VALUE_STR:
+    p->value.strval.size = codesize(&pc);
+    p->value.strval.s = (const char *)pc;
+    pc += p->value.strval.size;
+    break;
+  }
+
+  p->spcr = *pc++;
+  p->order = *pc++;
+  p->postype = *pc++;
+  p->pos = p->postype == POS_VALUE ? codesize(&pc) : 0;
+  p->nbitstype = *pc++;
+  p->nbits = p->nbitstype == NBITS_VALUE ? codesize(&pc) : 0;
+  return pc;
+}
+
+/* bits of the type, or 0 for strings */
+static size_t
+typebits(uint8_t spcr)
+{
+  switch (spcr) {
+  case TYPE_CHAR: case TYPE_UCHAR:
+    return 8 * sizeof(char);
+  case TYPE_SHORT: case TYPE_USHORT:
+    return 8 * sizeof(short);
+  case TYPE_INT: case TYPE_UINT:
+    return 8 * sizeof(int);
+  case TYPE_LONG: case TYPE_ULONG:
+    return 8 * sizeof(long);
+  case TYPE_LLONG: case TYPE_ULLONG:
+    return 8 * sizeof(long long);
+  case TYPE_FLOAT:
+    return 8 * sizeof(float);
+  case TYPE_DOUBLE:
+    return 8 * sizeof(double);
+  case TYPE_PTR:
+    return 8 * sizeof(void *);
+  default:
+    return 0;
+  }
+}
+
+static bool
+issigned(uint8_t spcr)
+{
+  return spcr == TYPE_CHAR || spcr == TYPE_SHORT || spcr == TYPE_INT ||
+    spcr == TYPE_LONG || spcr == TYPE_LLONG;
+}
+
+/* whether the bytes of the field are swapped */
+static bool
+isswapped(uint8_t order, size_t nbits)
+{
+  static const uint16_t one = 1;
+
+  if (nbits % 8 != 0 || nbits <= 8)
+    return false;
+  else if (order == ENDIAN_LITTLE)
+    return true;
+  else if (order == ENDIAN_NATIVE)
+    return *(const uint8_t *)&one == 1;
+  else
+    return false;
+}
+
+static inline uint64_t
+swapbytes(uint64_t v, size_t nbits)
+{
+#ifdef __GNUC__
+  return __builtin_bswap64(v) >> (64 - nbits);
+#else
+  uint64_t r = 0;
+
+  for (; nbits > 0; nbits -= 8, v >>= 8)
+    r = r << 8 | (v & 0xff);
+  return r;
+#endif
+}
+
+static inline uint64_t
+signextend(uint64_t v, size_t nbits)
+{
+  if (nbits < 64 && (v >> (nbits - 1) & 1))
+    v |= ~MASK64(nbits);
+  return v;
+}
+
+/* fetches the field from the stream */
+static bool
+ioreserve(bitio *io, size_t pos, size_t nbits)
+{
+  if (io->reader == NULL || nbits == 0)
+    return true;
+  return readerfill(io->reader, (io->base + pos) / 8,
+      (io->base + pos + nbits + 7) / 8);
+}
+
+static uint64_t
+ioget(bitio *io, size_t pos, size_t nbits)
+{
+  if (io->reader != NULL)
+    return getbits(io->reader->buf,
+        io->base + pos - io->reader->start * 8, nbits);
+  return getbits(io->bits, io->base + pos, nbits);
+}
+
+static bool
+iomatch(bitio *io, size_t pos, size_t nbits, const void *s)
+{
+  if (io->reader != NULL)
+    return biteq(io->reader->buf, io->base + pos - io->reader->start * 8,
+        s, 0, nbits);
+  return biteq(io->bits, io->base + pos, s, 0, nbits);
+}
+
+/* makes the field writable on the stream */
+static bool
+iowritable(bitio *io, size_t pos, size_t nbits)
+{
+  bitwriter *w = io->writer;
+
+  if (w == NULL || nbits == 0)
+    return true;
+  if (!writerfill(w, (io->base + pos) / 8, (io->base + pos + nbits + 7) / 8))
+    return false;
+  if (w->end < io->base + pos + nbits)
+    w->end = io->base + pos + nbits;
+  return true;
+}
+
+static bool
+ioput(bitio *io, size_t pos, size_t nbits, uint64_t v)
+{
+  if (io->writer != NULL) {
+    if (!iowritable(io, pos, nbits))
+      return false;
+    putbits(io->writer->buf, io->base + pos - io->writer->start * 8,
+        nbits, v);
+  } else {
+    putbits(io->bits, io->base + pos, nbits, v);
+  }
+  return true;
+}
+
+static void
+ioread(bitio *io, size_t pos, size_t nbits, void *buf)
+{
+  if (io->reader != NULL)
+    bitcpy(buf, 0, io->reader->buf,
+        io->base + pos - io->reader->start * 8, nbits);
+  else
+    bitcpy(buf, 0, io->bits, io->base + pos, nbits);
+}
+
+static bool
+iowrite(bitio *io, size_t pos, size_t nbits, const void *buf)
+{
+  bitwriter *w = io->writer;
+
+  if (w != NULL) {
+    if (writerdirect(w, io->base + pos, nbits, buf)) {
+      w->end = io->base + pos + nbits;
+      return true;
+    }
+    if (!iowritable(io, pos, nbits))
+      return false;
+    bitcpy(w->buf, io->base + pos - w->start * 8, buf, 0, nbits);
+  } else {
+    bitcpy(io->bits, io->base + pos, buf, 0, nbits);
+  }
+  return true;
+}
+
+static bool
+ioclear(bitio *io, size_t pos, size_t nbits)
+{
+  bitwriter *w = io->writer;
+
+  if (w != NULL) {
+    if (!iowritable(io, pos, nbits))
+      return false;
+    bitclear(w->buf, io->base + pos - w->start * 8, nbits);
+  } else {
+    bitclear(io->bits, io->base + pos, nbits);
+  }
+  return true;
+}
+
+/* reads an integer or float field as 64-bit value */
+static bool
+getvalue(bitio *io, const param *p, size_t pos, size_t nbits, uint64_t *v)
+{
+  if (nbits == 0 || nbits > 64)
+    return false;
+  *v = ioget(io, pos, nbits);
+  if (isswapped(p->order, nbits))
+    *v = swapbytes(*v, nbits);
+  if (issigned(p->spcr))
+    *v = signextend(*v, nbits);
+  return true;
+}
+
+static bool
+putvalue(bitio *io, const param *p, size_t pos, size_t nbits, uint64_t v)
+{
+  if (nbits > 64)
+    return false;
+  else if (nbits == 0)
+    return true;
+  v &= MASK64(nbits);
+  if (isswapped(p->order, nbits))
+    v = swapbytes(v, nbits);
+  return ioput(io, pos, nbits, v);
+}
+
+static bool
+tofloat(uint64_t v, size_t nbits, double *f)
+{
+  float f32;
+  double f64;
+  uint32_t u32;
+
+  if (nbits == 32) {
+    u32 = (uint32_t)v;
+    memcpy(&f32, &u32, sizeof(float));
+    *f = f32;
+  } else if (nbits == 64) {
+    memcpy(&f64, &v, sizeof(double));
+    *f = f64;
+  } else
+    return false;
+  return true;
+}
+
+static bool
+fromfloat(double f, size_t nbits, uint64_t *v)
+{
+  float f32;
+  uint32_t u32;
+
+  if (nbits == 32) {
+    f32 = (float)f;
+    memcpy(&u32, &f32, sizeof(float));
+    *v = u32;
+  } else if (nbits == 64) {
+    memcpy(v, &f, sizeof(double));
+  } else
+    return false;
+  return true;
+}
+
+static size_t
+scanc(bitio *io, const char *code, va_list ap)
+{
+  const uint8_t *pc;
+  param p;
+  size_t i, nparams, nvalues = 0, cur = 0, pos, nbits, len;
+  size_t *nbitsp;
+  uint64_t v;
+  double f;
+  char *str;
+
+  io->cur = 0;
+  if ((pc = codebegin(code, &nparams)) == NULL)
+    return 0;
+
+  for (i = 0; i < nparams; i++) {
+    pc = decodeparam(pc, &p);
+
+    switch (p.postype) {
+    case POS_VALUE:
+      pos = p.pos;
+      break;
+    case POS_VAR:
+      pos = va_arg(ap, size_t);
+      break;
+    case POS_PTR:
+      pos = cur;
+      *va_arg(ap, size_t *) = pos;
+      break;
+    default:
+      pos = cur;
+      break;
+    }
+
+    nbitsp = NULL;
+    switch (p.nbitstype) {
+    case NBITS_VALUE:
+      nbits = p.nbits;
+      break;
+    case NBITS_VAR:
+      nbits = va_arg(ap, size_t);
+      break;
+    case NBITS_PTR:
+      nbitsp = va_arg(ap, size_t *);
+      /* fall through */
+    default:
+      if (p.valtype == VALUE_STR)
+        nbits = p.value.strval.size * 8;
+      else
+        nbits = typebits(p.spcr);
+      break;
+    }
+
+    /* only an ignored field without a literal is not read */
+    if ((p.spcr != TYPE_IGNORE || p.valtype != VALUE_NULL) &&
+        !ioreserve(io, pos, nbits))
+      goto done;
+
+    if (p.valtype != VALUE_NULL) {
+      /* match the literal */
+      switch (p.valtype) {
+      case VALUE_STR:
+        if (nbits > p.value.strval.size * 8 ||
+            !iomatch(io, pos, nbits, p.value.strval.s))
+          goto done;
+        break;
+      case VALUE_FLOAT:
+        if (!getvalue(io, &p, pos, nbits, &v) || !tofloat(v, nbits, &f) ||
+            f != p.value.floatval)
+          goto done;
+        break;
+      default:
+        if (!getvalue(io, &p, pos, nbits, &v) ||
+            (v & MASK64(nbits)) != ((uint64_t)p.value.uintval & MASK64(nbits)))
+          goto done;
+        break;
+      }
+
+    } else {
+      switch (p.spcr) {
+      case TYPE_FLOAT: case TYPE_DOUBLE:
+        if (!getvalue(io, &p, pos, nbits, &v) || !tofloat(v, nbits, &f))
+          goto done;
+        if (p.spcr == TYPE_FLOAT)
+          *va_arg(ap, float *) = (float)f;
+        else
+          *va_arg(ap, double *) = f;
+        nvalues++;
+        break;
+
+      case TYPE_STR_NULL:
+        str = va_arg(ap, char *);
+        if (p.nbitstype == NBITS_VALUE || p.nbitstype == NBITS_VAR) {
+          ioread(io, pos, nbits, str);
+          str[(nbits + 7) / 8] = '\0';
+        } else {
+          for (len = 0; ; len++) {
+            if (!ioreserve(io, pos + len * 8, 8))
+              goto done;
+            if ((str[len] = (char)ioget(io, pos + len * 8, 8)) == '\0')
+              break;
+          }
+          nbits = (len + 1) * 8;
+        }
+        nvalues++;
+        break;
+
+      case TYPE_STR_NONNULL:
+        if (p.nbitstype != NBITS_VALUE && p.nbitstype != NBITS_VAR)
+          goto done;
+        ioread(io, pos, nbits, va_arg(ap, char *));
+        nvalues++;
+        break;
+
+      case TYPE_IGNORE:
+        break;
+
+      default:
+        if (!getvalue(io, &p, pos, nbits, &v))
+          goto done;
+        switch (p.spcr) {
+        case TYPE_CHAR:
+          *va_arg(ap, char *) = (char)v;
+          break;
+        case TYPE_UCHAR:
+          *va_arg(ap, unsigned char *) = (unsigned char)v;
+          break;
+        case TYPE_SHORT:
+          *va_arg(ap, short *) = (short)v;
+          break;
+        case TYPE_USHORT:
+          *va_arg(ap, unsigned short *) = (unsigned short)v;
+          break;
+        case TYPE_INT:
+          *va_arg(ap, int *) = (int)v;
+          break;
+        case TYPE_UINT:
+          *va_arg(ap, unsigned int *) = (unsigned int)v;
+          break;
+        case TYPE_LONG:
+          *va_arg(ap, long *) = (long)v;
+          break;
+        case TYPE_ULONG:
+          *va_arg(ap, unsigned long *) = (unsigned long)v;
+          break;
+        case TYPE_LLONG:
+          *va_arg(ap, long long *) = (long long)v;
+          break;
+        case TYPE_ULLONG:
+          *va_arg(ap, unsigned long long *) = (unsigned long long)v;
+          break;
+        case TYPE_PTR:
+          *va_arg(ap, void **) = (void *)(uintptr_t)v;
+          break;
+        }
+        nvalues++;
+        break;
+      }
+    }
+
+    if (nbitsp != NULL)
+      *nbitsp = nbits;
+    cur = pos + nbits;
+  }
+
+done:
+  io->cur = cur;
+  return nvalues;
+}
+
+static size_t
+printc(bitio *io, const char *code, va_list ap)
+{
+  const uint8_t *pc;
+  param p;
+  size_t i, nparams, cur = 0, end = 0, pos, nbits, len;
+  size_t *nbitsp;
+  uint64_t v;
+  double f;
+  const char *str;
+
+  io->cur = 0;
+  if ((pc = codebegin(code, &nparams)) == NULL)
+    return 0;
+
+  for (i = 0; i < nparams; i++) {
+    pc = decodeparam(pc, &p);
+
+    switch (p.postype) {
+    case POS_VALUE:
+      pos = p.pos;
+      break;
+    case POS_VAR:
+      pos = va_arg(ap, size_t);
+      break;
+    case POS_PTR:
+      pos = cur;
+      *va_arg(ap, size_t *) = pos;
+      break;
+    default:
+      pos = cur;
+      break;
+    }
+
+    nbitsp = NULL;
+    switch (p.nbitstype) {
+    case NBITS_VALUE:
+      nbits = p.nbits;
+      break;
+    case NBITS_VAR:
+      nbits = va_arg(ap, size_t);
+      break;
+    case NBITS_PTR:
+      nbitsp = va_arg(ap, size_t *);
+      /* fall through */
+    default:
+      nbits = typebits(p.spcr);
+      break;
+    }
+
+    /* the value */
+    str = NULL;
+    len = 0;
+    v = 0;
+    f = 0;
+    switch (p.valtype) {
+    case VALUE_INT:
+      v = (uint64_t)p.value.intval;
+      f = (double)p.value.intval;
+      break;
+    case VALUE_UINT:
+      v = (uint64_t)p.value.uintval;
+      f = (double)p.value.uintval;
+      break;
+    case VALUE_FLOAT:
+      v = (uint64_t)(int64_t)p.value.floatval;
+      f = p.value.floatval;
+      break;
+    case VALUE_STR:
+      str = p.value.strval.s;
+      len = p.value.strval.size;
+      break;
+    default:
+      switch (p.spcr) {
+      case TYPE_CHAR: case TYPE_SHORT: case TYPE_INT:
+        v = (uint64_t)va_arg(ap, int);
+        break;
+      case TYPE_UCHAR: case TYPE_USHORT: case TYPE_UINT:
+        v = (uint64_t)va_arg(ap, unsigned int);
+        break;
+      case TYPE_LONG:
+        v = (uint64_t)va_arg(ap, long);
+        break;
+      case TYPE_ULONG:
+        v = (uint64_t)va_arg(ap, unsigned long);
+        break;
+      case TYPE_LLONG:
+        v = (uint64_t)va_arg(ap, long long);
+        break;
+      case TYPE_ULLONG:
+        v = (uint64_t)va_arg(ap, unsigned long long);
+        break;
+      case TYPE_FLOAT: case TYPE_DOUBLE:
+        f = va_arg(ap, double);
+        break;
+      case TYPE_PTR:
+        v = (uint64_t)(uintptr_t)va_arg(ap, void *);
+        break;
+      case TYPE_STR_NULL: case TYPE_STR_NONNULL:
+        str = va_arg(ap, const char *);
+        len = strlen(str) + (p.spcr == TYPE_STR_NULL ? 1 : 0);
+        break;
+      }
+      break;
+    }
+
+    if (str != NULL) {
+      if (p.nbitstype != NBITS_VALUE && p.nbitstype != NBITS_VAR)
+        nbits = len * 8;
+      if (nbits > len * 8) {
+        if (!iowrite(io, pos, len * 8, str) ||
+            !ioclear(io, pos + len * 8, nbits - len * 8))
+          goto done;
+      } else if (!iowrite(io, pos, nbits, str)) {
+        goto done;
+      }
+    } else if (p.spcr == TYPE_FLOAT || p.spcr == TYPE_DOUBLE) {
+      if (!fromfloat(f, nbits, &v) || !putvalue(io, &p, pos, nbits, v))
+        goto done;
+    } else if (p.spcr == TYPE_IGNORE) {
+      if (!ioclear(io, pos, nbits))
+        goto done;
+    } else {
+      if (!putvalue(io, &p, pos, nbits, v))
+        goto done;
+    }
+
+    if (nbitsp != NULL)
+      *nbitsp = nbits;
+    cur = pos + nbits;
+    if (end < cur)
+      end = cur;
+  }
+
+done:
+  io->cur = cur;
+  return end;
+}
+
+size_t
+bitsscanc(const void *bits, size_t pos, const char *code, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, code);
+  n = bitvsscanc(bits, pos, code, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvsscanc(const void *bits, size_t pos, const char *code, va_list ap)
+{
+  bitio io;
+
+  io.bits = (uint8_t *)bits;
+  io.base = pos;
+  io.reader = NULL;
+  io.writer = NULL;
+  return scanc(&io, code, ap);
+}
+
+size_t
+bitsprintc(void *bits, size_t pos, const char *code, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, code);
+  n = bitvsprintc(bits, pos, code, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvsprintc(void *bits, size_t pos, const char *code, va_list ap)
+{
+  bitio io;
+
+  io.bits = (uint8_t *)bits;
+  io.base = pos;
+  io.reader = NULL;
+  io.writer = NULL;
+  return printc(&io, code, ap);
+}
+
+/*
+ * compiled format cache
+ *
+ * Programs are shared by content: a table of buckets keyed by the hash
+ * of the format, with a LRU list bounded by the capacity. Each thread
+ * also keeps a few slots keyed by the format pointer, so that a string
+ * literal used again is found without the lock. A slot holds a
+ * reference to the program, and the contents are compared on a hit in
+ * case the pointer is reused for another format.
+ */
+
+#define CACHEBUCKETS        512
+#define CACHESLOTS          16
+#define CACHECAPA           256
+
+typedef struct cacheentry {
+  struct cacheentry *next;
+  struct cacheentry *lruprev;
+  struct cacheentry *lrunext;
+  uint64_t hash;
+  size_t refs;
+  char *format;
+  char *code;
+} cacheentry;
+
+static struct {
+  pthread_mutex_t lock;
+  cacheentry *buckets[CACHEBUCKETS];
+  cacheentry *head;
+  cacheentry *tail;
+  size_t size;
+  size_t capa;
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+  unsigned long gen;
+} cache = {
+  PTHREAD_MUTEX_INITIALIZER, { NULL }, NULL, NULL, 0, CACHECAPA, 0, 0, 0, 0
+};
+
+#ifdef HAVE_TLS
+/* the hits of the thread slots, added to the cache's with the lock */
+static THREADLOCAL size_t cachehits;
+#endif
+
+static uint64_t
+formathash(const char *format)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  for (; *format != '\0'; format++)
+    h = (h ^ (uint8_t)*format) * 0x100000001b3ULL;
+  return h;
+}
+
+/* must be called with the lock */
+static void
+cacheunref(cacheentry *e)
+{
+  if (--e->refs == 0) {
+    free(e->format);
+    free(e->code);
+    free(e);
+  }
+}
+
+static void
+cacheunlink(cacheentry *e)
+{
+  cacheentry **p;
+
+  for (p = &cache.buckets[e->hash % CACHEBUCKETS]; *p != e; p = &(*p)->next)
+    ;
+  *p = e->next;
+
+  if (e->lruprev != NULL)
+    e->lruprev->lrunext = e->lrunext;
+  else
+    cache.head = e->lrunext;
+  if (e->lrunext != NULL)
+    e->lrunext->lruprev = e->lruprev;
+  else
+    cache.tail = e->lruprev;
+}
+
+static void
+cachefront(cacheentry *e)
+{
+  e->lruprev = NULL;
+  e->lrunext = cache.head;
+  if (cache.head != NULL)
+    cache.head->lruprev = e;
+  else
+    cache.tail = e;
+  cache.head = e;
+}
+
+static void
+cacheevict(size_t capa)
+{
+  cacheentry *e;
+
+  while (cache.size > capa) {
+    e = cache.tail;
+    cacheunlink(e);
+    cache.size--;
+    cache.evictions++;
+    cacheunref(e);
+  }
+}
+
+static cacheentry *
+cachefind(const char *format, uint64_t hash)
+{
+  cacheentry *e;
+
+  for (e = cache.buckets[hash % CACHEBUCKETS]; e != NULL; e = e->next) {
+    if (e->hash == hash && strcmp(e->format, format) == 0)
+      return e;
+  }
+  return NULL;
+}
+
+/* returns a referenced program, or NULL if the format is broken */
+static cacheentry *
+cacheget(const char *format)
+{
+  cacheentry *e, *found;
+  uint64_t hash;
+  char *code;
+
+  hash = formathash(format);
+  pthread_mutex_lock(&cache.lock);
+#ifdef HAVE_TLS
+  cache.hits += cachehits;
+  cachehits = 0;
+#endif
+  if ((e = cachefind(format, hash)) != NULL) {
+    cacheunlink(e);
+    e->next = cache.buckets[hash % CACHEBUCKETS];
+    cache.buckets[hash % CACHEBUCKETS] = e;
+    cachefront(e);
+    e->refs++;
+    cache.hits++;
+    pthread_mutex_unlock(&cache.lock);
+    return e;
+  }
+  cache.misses++;
+  pthread_mutex_unlock(&cache.lock);
+
+  /* compile without the lock */
+  if ((code = bitcompilef(format, NULL)) == NULL)
+    return NULL;
+  e = (cacheentry *)malloc(sizeof(cacheentry));
+  e->hash = hash;
+  e->refs = 1;
+  e->format = strdup(format);
+  e->code = code;
+
+  pthread_mutex_lock(&cache.lock);
+  if ((found = cachefind(format, hash)) != NULL) {
+    /* compiled by another thread meanwhile */
+    cacheunref(e);
+    e = found;
+    e->refs++;
+  } else if (cache.capa > 0) {
+    e->next = cache.buckets[hash % CACHEBUCKETS];
+    cache.buckets[hash % CACHEBUCKETS] = e;
+    cachefront(e);
+    cache.size++;
+    e->refs++;
+    cacheevict(cache.capa);
+  }
+  pthread_mutex_unlock(&cache.lock);
+  return e;
+}
+
+static void
+cacheput(cacheentry *e)
+{
+  pthread_mutex_lock(&cache.lock);
+  cacheunref(e);
+  pthread_mutex_unlock(&cache.lock);
+}
+
+#ifdef HAVE_TLS
+typedef struct cacheslot {
+  const char *format;
+  unsigned long gen;
+  cacheentry *entry;
+} cacheslot;
+
+static THREADLOCAL cacheslot cacheslots[CACHESLOTS];
+static pthread_key_t cachekey;
+static pthread_once_t cacheonce = PTHREAD_ONCE_INIT;
+
+/* releases the slots of an exiting thread */
+static void
+cacheexit(void *data)
+{
+  cacheslot *slots = data;
+  size_t i;
+
+  pthread_mutex_lock(&cache.lock);
+  cache.hits += cachehits;
+  cachehits = 0;
+  pthread_mutex_unlock(&cache.lock);
+  for (i = 0; i < CACHESLOTS; i++) {
+    if (slots[i].entry != NULL) {
+      cacheput(slots[i].entry);
+      slots[i].entry = NULL;
+    }
+  }
+}
+
+static void
+cacheinitkey(void)
+{
+  pthread_key_create(&cachekey, cacheexit);
+}
+#endif
+
+/*
+ * returns the code of the format; the entry to put back after use is
+ * stored to *hold, or NULL if the code is kept by the thread slots
+ */
+static const char *
+formatcode(const char *format, cacheentry **hold)
+{
+  cacheentry *e;
+#ifdef HAVE_TLS
+  cacheslot *slot;
+  unsigned long gen;
+
+  slot = &cacheslots[((uintptr_t)format >> 3) % CACHESLOTS];
+  gen = ATOMICLOAD(&cache.gen);
+  if (slot->format == format && slot->gen == gen &&
+      strcmp(slot->entry->format, format) == 0) {
+    cachehits++;
+    *hold = NULL;
+    return slot->entry->code;
+  }
+#endif
+
+  if ((e = cacheget(format)) == NULL)
+    return NULL;
+
+#ifdef HAVE_TLS
+  if (ATOMICLOAD(&cache.capa) > 0) {
+    pthread_once(&cacheonce, cacheinitkey);
+    pthread_setspecific(cachekey, cacheslots);
+    if (slot->entry != NULL)
+      cacheput(slot->entry);
+    slot->format = format;
+    slot->gen = gen;
+    slot->entry = e;
+    *hold = NULL;
+    return e->code;
+  }
+#endif
+  *hold = e;
+  return e->code;
+}
+
+void
+bitcachesize(size_t capa)
+{
+  pthread_mutex_lock(&cache.lock);
+#ifdef HAVE_TLS
+  ATOMICSTORE(&cache.capa, capa);
+  ATOMICADD(&cache.gen, 1);
+#else
+  cache.capa = capa;
+  cache.gen++;
+#endif
+  cacheevict(capa);
+  pthread_mutex_unlock(&cache.lock);
+}
+
+void
+bitcacheclear(void)
+{
+  pthread_mutex_lock(&cache.lock);
+  cacheevict(0);
+#ifdef HAVE_TLS
+  ATOMICADD(&cache.gen, 1);
+  cachehits = 0;
+#else
+  cache.gen++;
+#endif
+  cache.hits = 0;
+  cache.misses = 0;
+  cache.evictions = 0;
+  pthread_mutex_unlock(&cache.lock);
+}
+
+/*
+ * Stores the counts of the cache. The hits in the slots of other
+ * threads are counted at their next miss or when they exit.
+ */
+void
+bitcachestat(bitcachestats *stats)
+{
+  pthread_mutex_lock(&cache.lock);
+#ifdef HAVE_TLS
+  cache.hits += cachehits;
+  cachehits = 0;
+#endif
+  stats->hits = cache.hits;
+  stats->misses = cache.misses;
+  stats->evictions = cache.evictions;
+  stats->size = cache.size;
+  stats->capa = cache.capa;
+  pthread_mutex_unlock(&cache.lock);
+}
+
+size_t
+bitsscanf(const void *bits, size_t pos, const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvsscanf(bits, pos, format, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvsscanf(const void *bits, size_t pos, const char *format, va_list ap)
+{
+  cacheentry *hold;
+  const char *code;
+  size_t n;
+
+  if ((code = formatcode(format, &hold)) == NULL)
+    return 0;
+  n = bitvsscanc(bits, pos, code, ap);
+  if (hold != NULL)
+    cacheput(hold);
+  return n;
+}
+
+size_t
+bitsprintf(void *bits, size_t pos, const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvsprintf(bits, pos, format, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvsprintf(void *bits, size_t pos, const char *format, va_list ap)
+{
+  cacheentry *hold;
+  const char *code;
+  size_t n;
+
+  if ((code = formatcode(format, &hold)) == NULL)
+    return 0;
+  n = bitvsprintc(bits, pos, code, ap);
+  if (hold != NULL)
+    cacheput(hold);
+  return n;
+}
+
+size_t
+bitrscanc(bitreader *r, const char *code, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, code);
+  n = bitvrscanc(r, code, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvrscanc(bitreader *r, const char *code, va_list ap)
+{
+  bitio io;
+  size_t n;
+
+  io.bits = NULL;
+  io.base = r->pos;
+  io.reader = r;
+  io.writer = NULL;
+  n = scanc(&io, code, ap);
+  r->pos += io.cur;
+  return n;
+}
+
+size_t
+bitrscanf(bitreader *r, const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvrscanf(r, format, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvrscanf(bitreader *r, const char *format, va_list ap)
+{
+  cacheentry *hold;
+  const char *code;
+  size_t n;
+
+  if ((code = formatcode(format, &hold)) == NULL)
+    return 0;
+  n = bitvrscanc(r, code, ap);
+  if (hold != NULL)
+    cacheput(hold);
+  return n;
+}
+
+size_t
+bitscanf(const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvfscanf(stdin, format, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvscanf(const char *format, va_list ap)
+{
+  return bitvfscanf(stdin, format, ap);
+}
+
+size_t
+bitfscanf(FILE *fp, const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvfscanf(fp, format, ap);
+  va_end(ap);
+  return n;
+}
+
+/*
+ * reads a record of whole bytes from the file: the bytes up to the
+ * cursor and the fields, and no more, so that the next call starts at
+ * the following byte
+ */
+size_t
+bitvfscanf(FILE *fp, const char *format, va_list ap)
+{
+  bitreader r;
+  size_t n;
+
+  r.fp = fp;
+  r.capa = 64;
+  r.buf = (uint8_t *)malloc(r.capa);
+  r.len = 0;
+  r.start = 0;
+  r.pos = 0;
+  r.bytewise = true;
+  n = bitvrscanf(&r, format, ap);
+  readerfill(&r, 0, (r.pos + 7) / 8);
+  free(r.buf);
+  return n;
+}
+
+size_t
+bitwprintc(bitwriter *w, const char *code, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, code);
+  n = bitvwprintc(w, code, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvwprintc(bitwriter *w, const char *code, va_list ap)
+{
+  bitio io;
+  size_t n;
+
+  io.bits = NULL;
+  io.base = w->pos;
+  io.reader = NULL;
+  io.writer = w;
+  n = printc(&io, code, ap);
+  w->pos += io.cur;
+  return n;
+}
+
+size_t
+bitwprintf(bitwriter *w, const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvwprintf(w, format, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvwprintf(bitwriter *w, const char *format, va_list ap)
+{
+  cacheentry *hold;
+  const char *code;
+  size_t n;
+
+  if ((code = formatcode(format, &hold)) == NULL)
+    return 0;
+  n = bitvwprintc(w, code, ap);
+  if (hold != NULL)
+    cacheput(hold);
+  return n;
+}
+
+size_t
+bitprintf(const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvfprintf(stdout, format, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvprintf(const char *format, va_list ap)
+{
+  return bitvfprintf(stdout, format, ap);
+}
+
+size_t
+bitfprintf(FILE *fp, const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvfprintf(fp, format, ap);
+  va_end(ap);
+  return n;
+}
+
+/*
+ * writes a record of whole bytes to the file, padding the last byte
+ * with zeros; stdio buffers the records
+ */
+size_t
+bitvfprintf(FILE *fp, const char *format, va_list ap)
+{
+  bitwriter *w;
+  size_t n;
+
+  w = newwriter(-1, fp, 64);
+  w->keep = true;
+  n = bitvwprintf(w, format, ap);
+  bitwriterclose(w);
+  return n;
+}
+
+/*
+ * batch decoding
+ *
+ * Decodes count records of a fixed layout, stride bits apart, a field
+ * at a time: each value field is stored to its own array with one
+ * element per record (nbits/8 bytes for '%A'). The fields are
+ * extracted in blocks with the gather kernel and converted by type.
+ * '?' operands are taken once for all records; '^' operands and '%a'
+ * have no fixed layout and are refused.
+ *
+ * Returns the number of records decoded, which stops before the first
+ * record with a wrong literal.
+ */
+
+#define BATCHBLOCK          (BLOCKSIZE / 8)
+
+/* gathers n fields without reading past the byte at end */
+static void
+gatherfields(uint64_t *dest, const uint8_t *bits, size_t pos, size_t stride,
+    size_t nbits, size_t n, size_t end)
+{
+  size_t lim, nsafe;
+
+  /* the 8 bytes from a field start below lim are readable */
+  lim = end >= 8 ? (end - 7) * 8 : 0;
+  if (pos >= lim)
+    nsafe = 0;
+  else if (stride == 0)
+    nsafe = n;
+  else
+    nsafe = (lim - pos - 1) / stride + 1;
+  if (nsafe > n)
+    nsafe = n;
+
+  kernels.gather(dest, bits, pos, stride, nbits, nsafe);
+  gatherbits(dest + nsafe, bits, pos + nsafe * stride, stride, nbits,
+      n - nsafe);
+}
+
+/* converts the values of a block and stores them from out[i] */
+static void
+storefields(const param *p, void *out, size_t i,
+    uint64_t *v, size_t n, size_t nbits)
+{
+  size_t k;
+  double f = 0;
+
+  if (isswapped(p->order, nbits)) {
+    for (k = 0; k < n; k++)
+      v[k] = swapbytes(v[k], nbits);
+  }
+  if (issigned(p->spcr) && nbits < 64) {
+    for (k = 0; k < n; k++)
+      v[k] = (uint64_t)((int64_t)(v[k] << (64 - nbits)) >> (64 - nbits));
+  }
+
+  switch (p->spcr) {
+  case TYPE_CHAR:
+    for (k = 0; k < n; k++)
+      ((char *)out)[i + k] = (char)v[k];
+    break;
+  case TYPE_UCHAR:
+    for (k = 0; k < n; k++)
+      ((unsigned char *)out)[i + k] = (unsigned char)v[k];
+    break;
+  case TYPE_SHORT:
+    for (k = 0; k < n; k++)
+      ((short *)out)[i + k] = (short)v[k];
+    break;
+  case TYPE_USHORT:
+    for (k = 0; k < n; k++)
+      ((unsigned short *)out)[i + k] = (unsigned short)v[k];
+    break;
+  case TYPE_INT:
+    for (k = 0; k < n; k++)
+      ((int *)out)[i + k] = (int)v[k];
+    break;
+  case TYPE_UINT:
+    for (k = 0; k < n; k++)
+      ((unsigned int *)out)[i + k] = (unsigned int)v[k];
+    break;
+  case TYPE_LONG:
+    for (k = 0; k < n; k++)
+      ((long *)out)[i + k] = (long)v[k];
+    break;
+  case TYPE_ULONG:
+    for (k = 0; k < n; k++)
+      ((unsigned long *)out)[i + k] = (unsigned long)v[k];
+    break;
+  case TYPE_LLONG:
+    for (k = 0; k < n; k++)
+      ((long long *)out)[i + k] = (long long)v[k];
+    break;
+  case TYPE_ULLONG:
+    for (k = 0; k < n; k++)
+      ((unsigned long long *)out)[i + k] = (unsigned long long)v[k];
+    break;
+  case TYPE_FLOAT:
+    for (k = 0; k < n; k++) {
+      tofloat(v[k], nbits, &f);
+      ((float *)out)[i + k] = (float)f;
+    }
+    break;
+  case TYPE_DOUBLE:
+    for (k = 0; k < n; k++) {
+      tofloat(v[k], nbits, &f);
+      ((double *)out)[i + k] = f;
+    }
+    break;
+  case TYPE_PTR:
+    for (k = 0; k < n; k++)
+      ((void **)out)[i + k] = (void *)(uintptr_t)v[k];
+    break;
+  }
+}
+
+/* returns the first record whose literal does not match */
+static size_t
+matchfields(const param *p, const uint8_t *bits, size_t pos, size_t stride,
+    size_t nbits, size_t count, size_t end)
+{
+  uint64_t v[BATCHBLOCK], lit;
+  size_t i, k, n;
+  double f;
+
+  if (p->valtype == VALUE_STR) {
+    if (nbits > p->value.strval.size * 8)
+      return 0;
+    for (i = 0; i < count; i++, pos += stride) {
+      if (!biteq(bits, pos, p->value.strval.s, 0, nbits))
+        return i;
+    }
+    return count;
+  }
+
+  if (nbits == 0 || nbits > 64)
+    return 0;
+  lit = (uint64_t)p->value.uintval & MASK64(nbits);
+  for (i = 0; i < count; i += n) {
+    n = count - i < BATCHBLOCK ? count - i : BATCHBLOCK;
+    gatherfields(v, bits, pos + i * stride, stride, nbits, n, end);
+    for (k = 0; k < n; k++) {
+      if (isswapped(p->order, nbits))
+        v[k] = swapbytes(v[k], nbits);
+      if (p->valtype == VALUE_FLOAT) {
+        if (!tofloat(v[k], nbits, &f) || f != p->value.floatval)
+          return i + k;
+      } else if (v[k] != lit) {
+        return i + k;
+      }
+    }
+  }
+  return count;
+}
+
+static size_t
+batchscanc(const uint8_t *bits, size_t pos, size_t stride, size_t count,
+    const char *code, va_list ap)
+{
+  const uint8_t *pc;
+  param *params;
+  void **outs;
+  uint64_t v[BATCHBLOCK];
+  size_t i, k, n, nparams, cur = 0, end = 0, nbytes;
+
+  if ((pc = codebegin(code, &nparams)) == NULL)
+    return 0;
+  if (count == 0 || nparams == 0)
+    return count;
+
+  params = (param *)malloc(sizeof(param) * nparams);
+  outs = (void **)malloc(sizeof(void *) * nparams);
+
+  /* resolve the layout and take the arguments */
+  for (i = 0; i < nparams; i++) {
+    pc = decodeparam(pc, &params[i]);
+    if (params[i].postype == POS_PTR || params[i].nbitstype == NBITS_PTR ||
+        params[i].spcr == TYPE_STR_NULL) {
+      count = 0;
+      goto done;
+    }
+
+    if (params[i].postype == POS_VAR)
+      params[i].pos = va_arg(ap, size_t);
+    else if (params[i].postype != POS_VALUE)
+      params[i].pos = cur;
+
+    if (params[i].nbitstype == NBITS_VAR)
+      params[i].nbits = va_arg(ap, size_t);
+    else if (params[i].nbitstype != NBITS_VALUE) {
+      if (params[i].valtype == VALUE_STR)
+        params[i].nbits = params[i].value.strval.size * 8;
+      else if (params[i].spcr == TYPE_STR_NONNULL) {
+        count = 0;
+        goto done;
+      } else
+        params[i].nbits = typebits(params[i].spcr);
+    }
+
+    outs[i] = NULL;
+    if (params[i].valtype == VALUE_NULL && params[i].spcr != TYPE_IGNORE)
+      outs[i] = va_arg(ap, void *);
+    cur = params[i].pos + params[i].nbits;
+    if (end < cur)
+      end = cur;
+  }
+  /* the byte just after the last record */
+  end = (pos + (count - 1) * stride + end + 7) / 8;
+
+  /* literals first, to know how many records to decode */
+  for (i = 0; i < nparams && count > 0; i++) {
+    if (params[i].valtype != VALUE_NULL && params[i].nbits > 0)
+      count = matchfields(&params[i], bits, pos + params[i].pos, stride,
+          params[i].nbits, count, end);
+  }
+
+  for (i = 0; i < nparams && count > 0; i++) {
+    if (outs[i] == NULL)
+      continue;
+
+    if (params[i].spcr == TYPE_STR_NONNULL) {
+      nbytes = (params[i].nbits + 7) / 8;
+      for (k = 0; k < count; k++) {
+        memset((uint8_t *)outs[i] + k * nbytes, 0, nbytes);
+        bitcpy((uint8_t *)outs[i] + k * nbytes, 0,
+            bits, pos + params[i].pos + k * stride, params[i].nbits);
+      }
+      continue;
+    }
+
+    if (params[i].nbits > 64 || ((params[i].spcr == TYPE_FLOAT ||
+            params[i].spcr == TYPE_DOUBLE) &&
+          params[i].nbits != 32 && params[i].nbits != 64)) {
+      count = 0;
+      break;
+    }
+    for (k = 0; k < count; k += n) {
+      n = count - k < BATCHBLOCK ? count - k : BATCHBLOCK;
+      if (params[i].nbits == 0)
+        memset(v, 0, sizeof(uint64_t) * n);
+      else
+        gatherfields(v, bits, pos + params[i].pos + k * stride, stride,
+            params[i].nbits, n, end);
+      storefields(&params[i], outs[i], k, v, n, params[i].nbits);
+    }
+  }
+
+done:
+  free(params);
+  free(outs);
+  return count;
+}
+
+size_t
+bitbatchscanc(const void *bits, size_t pos, size_t stride, size_t count,
+    const char *code, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, code);
+  n = bitvbatchscanc(bits, pos, stride, count, code, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvbatchscanc(const void *bits, size_t pos, size_t stride, size_t count,
+    const char *code, va_list ap)
+{
+  return batchscanc((const uint8_t *)bits, pos, stride, count, code, ap);
+}
+
+size_t
+bitbatchscanf(const void *bits, size_t pos, size_t stride, size_t count,
+    const char *format, ...)
+{
+  va_list ap;
+  size_t n;
+
+  va_start(ap, format);
+  n = bitvbatchscanf(bits, pos, stride, count, format, ap);
+  va_end(ap);
+  return n;
+}
+
+size_t
+bitvbatchscanf(const void *bits, size_t pos, size_t stride, size_t count,
+    const char *format, va_list ap)
+{
+  cacheentry *hold;
+  const char *code;
+  size_t n;
+
+  if ((code = formatcode(format, &hold)) == NULL)
+    return 0;
+  n = bitvbatchscanc(bits, pos, stride, count, code, ap);
+  if (hold != NULL)
+    cacheput(hold);
+  return n;
+}
+
+/*
+ * field views
+ *
+ * A layout resolves the position and size of every param of a fixed
+ * format once. A view is the layout with a record origin, and reads a
+ * field only when it is asked for. Fields are numbered from 0 in the
+ * order of the params, literals included.
+ */
+
+struct bitlayout {
+  char *code;           /* a copy, which the params point into */
+  size_t size;
+  size_t count;
+  param params[];
+};
+
+bitlayout *
+bitlayoutc(const char *code)
+{
+  bitlayout *layout;
+  const uint8_t *pc;
+  param *p;
+  size_t i, nparams, codelen, cur = 0;
+
+  if ((pc = codebegin(code, &nparams)) == NULL)
+    return NULL;
+  memcpy(&codelen, code + 1, sizeof(size_t));
+
+  layout = (bitlayout *)malloc(sizeof(bitlayout) + sizeof(param) * nparams);
+  layout->code = (char *)malloc(codelen);
+  memcpy(layout->code, code, codelen);
+  layout->size = 0;
+  layout->count = nparams;
+
+  pc = codebegin(layout->code, &nparams);
+  for (i = 0; i < nparams; i++) {
+    p = &layout->params[i];
+    pc = decodeparam(pc, p);
+    if (p->postype == POS_VAR || p->postype == POS_PTR ||
+        p->nbitstype == NBITS_VAR || p->nbitstype == NBITS_PTR ||
+        p->spcr == TYPE_STR_NULL)
+      goto error;
+
+    if (p->postype != POS_VALUE)
+      p->pos = cur;
+    if (p->nbitstype != NBITS_VALUE) {
+      if (p->valtype == VALUE_STR)
+        p->nbits = p->value.strval.size * 8;
+      else if (p->spcr == TYPE_STR_NONNULL)
+        goto error;
+      else
+        p->nbits = typebits(p->spcr);
+    }
+    if (p->spcr != TYPE_STR_NONNULL && p->valtype != VALUE_STR &&
+        p->nbits > 64)
+      goto error;
+
+    cur = p->pos + p->nbits;
+    if (layout->size < cur)
+      layout->size = cur;
+  }
+  return layout;
+
+error:
+  bitlayoutfree(layout);
+  return NULL;
+}
+
+bitlayout *
+bitlayoutf(const char *format)
+{
+  bitlayout *layout;
+  char *code;
+
+  if ((code = bitcompilef(format, NULL)) == NULL)
+    return NULL;
+  layout = bitlayoutc(code);
+  free(code);
+  return layout;
+}
+
+void
+bitlayoutfree(bitlayout *layout)
+{
+  free(layout->code);
+  free(layout);
+}
+
+size_t
+bitlayoutsize(const bitlayout *layout)
+{
+  return layout->size;
+}
+
+size_t
+bitlayoutcount(const bitlayout *layout)
+{
+  return layout->count;
+}
+
+bitview
+bitviewmake(const bitlayout *layout, const void *bits, size_t pos)
+{
+  bitview view;
+
+  view.layout = layout;
+  view.bits = bits;
+  view.pos = pos;
+  return view;
+}
+
+/* the integer value of the field, sign-extended for signed types */
+uint64_t
+bitviewget(bitview view, size_t field)
+{
+  const param *p;
+  uint64_t v;
+
+  if (field >= view.layout->count)
+    return 0;
+  p = &view.layout->params[field];
+  if (p->nbits == 0 || p->nbits > 64)
+    return 0;
+
+  v = getbits(view.bits, view.pos + p->pos, p->nbits);
+  if (isswapped(p->order, p->nbits))
+    v = swapbytes(v, p->nbits);
+  if (issigned(p->spcr))
+    v = signextend(v, p->nbits);
+  return v;
+}
+
+double
+bitviewgetf(bitview view, size_t field)
+{
+  double f;
+
+  if (field >= view.layout->count ||
+      !tofloat(bitviewget(view, field), view.layout->params[field].nbits, &f))
+    return 0;
+  return f;
+}
+
+/* copies the bits of the field to dest, and returns the number */
+size_t
+bitviewcopy(bitview view, size_t field, void *dest)
+{
+  const param *p;
+
+  if (field >= view.layout->count)
+    return 0;
+  p = &view.layout->params[field];
+  bitcpy(dest, 0, view.bits, view.pos + p->pos, p->nbits);
+  return p->nbits;
+}
+
+/* whether the literals of the record match */
+bool
+bitviewvalid(bitview view)
+{
+  const param *p;
+  size_t i;
+  double f;
+
+  for (i = 0; i < view.layout->count; i++) {
+    p = &view.layout->params[i];
+    switch (p->valtype) {
+    case VALUE_STR:
+      if (!biteq(view.bits, view.pos + p->pos, p->value.strval.s, 0,
+            p->nbits))
+        return false;
+      break;
+    case VALUE_FLOAT:
+      f = bitviewgetf(view, i);
+      if (f != p->value.floatval)
+        return false;
+      break;
+    case VALUE_INT: case VALUE_UINT:
+      if ((bitviewget(view, i) & MASK64(p->nbits)) !=
+          ((uint64_t)p->value.uintval & MASK64(p->nbits)))
+        return false;
+      break;
+    }
+  }
+  return true;
+}
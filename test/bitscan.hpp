@@ -0,0 +1,1219 @@
+/*
+ * Copyright (c) 2010 SUZUKI Tetsuya <suzuki@spice-of-life.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __BITSCAN_HPP__
+#define __BITSCAN_HPP__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "bitscan.h"
+
+/*
+ * compile-time formats (C++17)
+ *
+ *   constexpr auto fmt = BITFORMAT("%I>@0:12 %s< %#:4");
+ *   fmt.print(bits, u, s);
+ *   fmt.scan(bits, &u, &s);
+ *
+ * The format is parsed while compiling, with the grammar of
+ * bitcompilef, and a broken format does not compile. Every field has a
+ * constant position and size, so reads and writes are unrolled with
+ * constant shifts and masks. Positions are relative to the first bit
+ * of the bytes; use bitsscanf for an unaligned origin.
+ *
+ * Only fixed layouts can be compiled: '?' and '^' operands and the
+ * NUL-terminated '%a' are left to the runtime functions.
+ */
+
+namespace bitscan {
+
+namespace detail {
+
+enum class order { native, big, little };
+
+enum class literal { none, sint, uint, real, str };
+
+struct field {
+  char type = 0;
+  order byteorder = order::native;
+  std::size_t pos = 0;
+  std::size_t nbits = 0;
+  literal valtype = literal::none;
+  long long ival = 0;
+  unsigned long long uval = 0;
+  double fval = 0;
+  std::size_t stroff = 0;
+  std::size_t strlen = 0;
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+constexpr bool littlehost = false;
+#else
+constexpr bool littlehost = true;
+#endif
+
+constexpr bool
+isdigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+constexpr bool
+isalnum(char c)
+{
+  return isdigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr std::size_t
+typebits(char type)
+{
+  switch (type) {
+  case 'c': case 'C':
+    return 8 * sizeof(char);
+  case 's': case 'S':
+    return 8 * sizeof(short);
+  case 'i': case 'I':
+    return 8 * sizeof(int);
+  case 'l': case 'L':
+    return 8 * sizeof(long);
+  case 'q': case 'Q':
+    return 8 * sizeof(long long);
+  case 'f':
+    return 8 * sizeof(float);
+  case 'd':
+    return 8 * sizeof(double);
+  case '^':
+    return 8 * sizeof(void *);
+  default:
+    return 0;
+  }
+}
+
+/* parses the format into fields, or only counts them if out is null */
+constexpr std::size_t
+parse(std::string_view fmt, field *out)
+{
+  std::size_t i = 0, n = 0, cur = 0, start = 0, ndigits = 0;
+  unsigned long long base = 0, v = 0;
+  bool neg = false;
+  char quote = 0;
+
+  while (i < fmt.size()) {
+    field f;
+
+    switch (fmt[i]) {
+    case ' ':
+      i++;
+      continue;
+
+    case '%':
+      break;
+
+    case '\'':
+      if (i + 2 >= fmt.size() || fmt[i + 2] != '\'')
+        throw "unterminated character literal";
+      f.valtype = literal::uint;
+      f.uval = (unsigned char)fmt[i + 1];
+      i += 3;
+      break;
+
+    case '"': case '|':
+      quote = fmt[i++];
+      start = i;
+      while (i < fmt.size() && fmt[i] != quote)
+        i++;
+      if (i == fmt.size())
+        throw "unterminated string literal";
+      f.valtype = literal::str;
+      f.stroff = start;
+      f.strlen = i - start;
+      i++;
+      break;
+
+    case '.': case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+      neg = false;
+      if (fmt[i] == '-') {
+        neg = true;
+        i++;
+      }
+
+      base = 0;
+      ndigits = 0;
+      while (i < fmt.size() && isdigit(fmt[i])) {
+        base = base * 10 + (fmt[i] - '0');
+        ndigits++;
+        i++;
+      }
+
+      if (i < fmt.size() && fmt[i] == '#') {
+        if (ndigits == 0 || base < 2 || base > 36)
+          throw "base must be 2 to 36";
+        i++;
+        ndigits = 0;
+        f.uval = 0;
+        while (i < fmt.size() && isalnum(fmt[i])) {
+          if (isdigit(fmt[i]))
+            v = fmt[i] - '0';
+          else if (fmt[i] >= 'a')
+            v = fmt[i] - 'a' + 10;
+          else
+            v = fmt[i] - 'A' + 10;
+          if (v >= base)
+            throw "digit out of the base";
+          f.uval = f.uval * base + v;
+          ndigits++;
+          i++;
+        }
+      } else if (i < fmt.size() && fmt[i] == '.') {
+        /* one division rounds as strtod for short literals */
+        double scale = 1;
+
+        i++;
+        if (i == fmt.size() || !isdigit(fmt[i]))
+          throw "digits expected after the point";
+        while (i < fmt.size() && isdigit(fmt[i])) {
+          base = base * 10 + (fmt[i] - '0');
+          scale *= 10;
+          i++;
+        }
+        f.fval = (double)base / scale;
+        if (neg)
+          f.fval = -f.fval;
+        f.valtype = literal::real;
+        break;
+      } else {
+        f.uval = base;
+      }
+
+      if (ndigits == 0)
+        throw "digits expected";
+      if (neg) {
+        f.valtype = literal::sint;
+        f.ival = -(long long)f.uval;
+        f.uval = (unsigned long long)f.ival;
+      } else {
+        f.valtype = literal::uint;
+        f.ival = (long long)f.uval;
+      }
+      break;
+
+    default:
+      throw "unexpected character";
+    }
+
+    /* type specifier */
+    if (i == fmt.size() || fmt[i] != '%')
+      throw "'%' expected";
+    i++;
+    if (i == fmt.size())
+      throw "type specifier expected";
+    switch (fmt[i]) {
+    case 'c': case 'C': case 's': case 'S': case 'i': case 'I':
+    case 'l': case 'L': case 'q': case 'Q': case 'f': case 'd':
+    case '^': case 'A': case '#':
+      f.type = fmt[i++];
+      break;
+    case 'a':
+      throw "'%a' has no fixed size; use bitsscanf";
+    default:
+      throw "unknown type specifier";
+    }
+
+    /* byte order */
+    if (i < fmt.size()) {
+      switch (fmt[i]) {
+      case '=':
+        i++;
+        break;
+      case '>': case '!':
+        f.byteorder = order::big;
+        i++;
+        break;
+      case '<':
+        f.byteorder = order::little;
+        i++;
+        break;
+      }
+    }
+
+    /* pos */
+    f.pos = cur;
+    if (i < fmt.size() && fmt[i] == '@') {
+      i++;
+      if (i < fmt.size() && fmt[i] == '+') {
+        i++;
+      } else if (i < fmt.size() && isdigit(fmt[i])) {
+        f.pos = 0;
+        while (i < fmt.size() && isdigit(fmt[i]))
+          f.pos = f.pos * 10 + (fmt[i++] - '0');
+      } else if (i < fmt.size() && (fmt[i] == '?' || fmt[i] == '^')) {
+        throw "variable position; use bitsscanf";
+      } else {
+        throw "position expected";
+      }
+    }
+
+    /* bits */
+    if (f.valtype == literal::str)
+      f.nbits = f.strlen * 8;
+    else
+      f.nbits = typebits(f.type);
+    if (i < fmt.size() && fmt[i] == ':') {
+      i++;
+      if (i < fmt.size() && isdigit(fmt[i])) {
+        f.nbits = 0;
+        while (i < fmt.size() && isdigit(fmt[i]))
+          f.nbits = f.nbits * 10 + (fmt[i++] - '0');
+      } else if (i < fmt.size() && (fmt[i] == '?' || fmt[i] == '^')) {
+        throw "variable number of bits; use bitsscanf";
+      } else {
+        throw "number of bits expected";
+      }
+    } else if (f.type == 'A' && f.valtype != literal::str) {
+      throw "'%A' needs the number of bits";
+    }
+
+    if (f.valtype == literal::str) {
+      if (f.nbits > f.strlen * 8)
+        throw "string literal is shorter than its bits";
+    } else if (f.type == 'f' || f.type == 'd') {
+      if (f.nbits != 32 && f.nbits != 64)
+        throw "float needs 32 or 64 bits";
+    } else if (f.type != 'A' && f.type != '#' && f.nbits > 64) {
+      throw "more than 64 bits";
+    }
+
+    cur = f.pos + f.nbits;
+    if (out != nullptr)
+      out[n] = f;
+    n++;
+  }
+  return n;
+}
+
+template <char Type> struct ctype;
+template <> struct ctype<'c'> { using type = char; };
+template <> struct ctype<'C'> { using type = unsigned char; };
+template <> struct ctype<'s'> { using type = short; };
+template <> struct ctype<'S'> { using type = unsigned short; };
+template <> struct ctype<'i'> { using type = int; };
+template <> struct ctype<'I'> { using type = unsigned int; };
+template <> struct ctype<'l'> { using type = long; };
+template <> struct ctype<'L'> { using type = unsigned long; };
+template <> struct ctype<'q'> { using type = long long; };
+template <> struct ctype<'Q'> { using type = unsigned long long; };
+template <> struct ctype<'f'> { using type = float; };
+template <> struct ctype<'d'> { using type = double; };
+template <> struct ctype<'^'> { using type = void *; };
+template <> struct ctype<'A'> { using type = char; };
+
+constexpr std::uint64_t
+mask(std::size_t n)
+{
+  return n >= 64 ? ~(std::uint64_t)0 : ((std::uint64_t)1 << n) - 1;
+}
+
+/* reads N bits at Pos; a field over 9 bytes is split in two */
+template <std::size_t Pos, std::size_t N>
+inline std::uint64_t
+getfield(const std::uint8_t *p)
+{
+  constexpr std::size_t first = Pos / 8;
+  constexpr std::size_t nbytes = (Pos + N + 7) / 8 - first;
+  constexpr std::size_t tail = nbytes * 8 - Pos % 8 - N;
+  std::uint64_t v = 0;
+
+  if constexpr (N == 0) {
+    return 0;
+  } else if constexpr (nbytes > 8) {
+    constexpr std::size_t n1 = 64 - Pos % 8;
+    return getfield<Pos, n1>(p) << (N - n1) | getfield<Pos + n1, N - n1>(p);
+  } else {
+    for (std::size_t i = 0; i < nbytes; i++)
+      v = v << 8 | p[first + i];
+    return v >> tail & mask(N);
+  }
+}
+
+template <std::size_t Pos, std::size_t N>
+inline void
+putfield(std::uint8_t *p, std::uint64_t v)
+{
+  constexpr std::size_t first = Pos / 8;
+  constexpr std::size_t nbytes = (Pos + N + 7) / 8 - first;
+  constexpr std::size_t tail = nbytes * 8 - Pos % 8 - N;
+  constexpr std::uint64_t m = mask(N) << tail;
+  std::size_t shift;
+
+  if constexpr (N == 0) {
+    return;
+  } else if constexpr (nbytes > 8) {
+    constexpr std::size_t n1 = 64 - Pos % 8;
+    putfield<Pos, n1>(p, v >> (N - n1));
+    putfield<Pos + n1, N - n1>(p, v);
+  } else {
+    v = (v & mask(N)) << tail;
+    for (std::size_t i = 0; i < nbytes; i++) {
+      shift = 8 * (nbytes - 1 - i);
+      p[first + i] = (std::uint8_t)((p[first + i] & ~(m >> shift)) |
+          (v >> shift));
+    }
+  }
+}
+
+template <order Order, std::size_t N>
+constexpr bool
+isswapped()
+{
+  if (N % 8 != 0 || N <= 8)
+    return false;
+  return Order == order::little || (Order == order::native && littlehost);
+}
+
+template <std::size_t N>
+inline std::uint64_t
+swapbytes(std::uint64_t v)
+{
+  std::uint64_t r = 0;
+
+  for (std::size_t i = 0; i < N / 8; i++, v >>= 8)
+    r = r << 8 | (v & 0xff);
+  return r;
+}
+
+/* reads the field as 64-bit value, swapped and sign-extended */
+template <std::size_t Pos, std::size_t N, order Order, bool Signed>
+inline std::uint64_t
+getvalue(const std::uint8_t *p)
+{
+  std::uint64_t v = getfield<Pos, N>(p);
+
+  if constexpr (isswapped<Order, N>())
+    v = swapbytes<N>(v);
+  if constexpr (Signed && N > 0 && N < 64) {
+    if (v >> (N - 1) & 1)
+      v |= ~mask(N);
+  }
+  return v;
+}
+
+template <std::size_t Pos, std::size_t N, order Order>
+inline void
+putvalue(std::uint8_t *p, std::uint64_t v)
+{
+  if constexpr (isswapped<Order, N>())
+    v = swapbytes<N>(v & mask(N));
+  putfield<Pos, N>(p, v);
+}
+
+template <std::size_t N>
+inline double
+tofloat(std::uint64_t v)
+{
+  if constexpr (N == 32) {
+    std::uint32_t u = (std::uint32_t)v;
+    float f;
+
+    std::memcpy(&f, &u, sizeof(float));
+    return f;
+  } else {
+    double d;
+
+    std::memcpy(&d, &v, sizeof(double));
+    return d;
+  }
+}
+
+template <std::size_t N>
+inline std::uint64_t
+fromfloat(double d)
+{
+  if constexpr (N == 32) {
+    float f = (float)d;
+    std::uint32_t u;
+
+    std::memcpy(&u, &f, sizeof(float));
+    return u;
+  } else {
+    std::uint64_t v;
+
+    std::memcpy(&v, &d, sizeof(double));
+    return v;
+  }
+}
+
+template <std::size_t Pos, std::size_t N>
+inline void
+readbytes(const std::uint8_t *p, void *dest)
+{
+  if constexpr (Pos % 8 == 0 && N % 8 == 0)
+    std::memcpy(dest, p + Pos / 8, N / 8);
+  else
+    bitcpy(dest, 0, p, Pos, N);
+}
+
+template <std::size_t Pos, std::size_t N>
+inline void
+writebytes(std::uint8_t *p, const void *src)
+{
+  if constexpr (Pos % 8 == 0 && N % 8 == 0)
+    std::memcpy(p + Pos / 8, src, N / 8);
+  else
+    bitcpy(p, Pos, src, 0, N);
+}
+
+template <std::size_t Pos, std::size_t N>
+inline bool
+equalbytes(const std::uint8_t *p, const void *s)
+{
+  if constexpr (Pos % 8 == 0 && N % 8 == 0)
+    return std::memcmp(p + Pos / 8, s, N / 8) == 0;
+  else
+    return biteq(p, Pos, s, 0, N);
+}
+
+template <class S>
+struct layout {
+  static constexpr std::size_t count = parse(S::value(), nullptr);
+  static constexpr std::array<field, count> fields = [] {
+    std::array<field, count> a{};
+    parse(S::value(), a.data());
+    return a;
+  }();
+
+  static constexpr bool
+  takesarg(std::size_t i)
+  {
+    return fields[i].valtype == literal::none && fields[i].type != '#';
+  }
+
+  static constexpr std::size_t
+  argindex(std::size_t i)
+  {
+    std::size_t n = 0;
+
+    for (std::size_t k = 0; k < i; k++)
+      n += takesarg(k) ? 1 : 0;
+    return n;
+  }
+
+  static constexpr std::size_t
+  end()
+  {
+    std::size_t e = 0;
+
+    for (std::size_t k = 0; k < count; k++) {
+      if (e < fields[k].pos + fields[k].nbits)
+        e = fields[k].pos + fields[k].nbits;
+    }
+    return e;
+  }
+};
+
+} /* namespace detail */
+
+template <class S>
+class format {
+  using layout = detail::layout<S>;
+  using field = detail::field;
+  using literal = detail::literal;
+
+public:
+  static constexpr std::size_t nfields = layout::count;
+  static constexpr std::size_t nargs = layout::argindex(nfields);
+  static constexpr std::size_t size = layout::end();
+
+  /* parses the format as soon as the type is used */
+  static_assert(nfields == layout::fields.size(), "");
+
+  /* returns the number of stored values, stopping at a wrong literal */
+  template <class... Args>
+  std::size_t
+  scan(const void *bits, Args... args) const
+  {
+    static_assert(sizeof...(Args) == nargs,
+        "wrong number of arguments for the format");
+    const std::uint8_t *p = static_cast<const std::uint8_t *>(bits);
+    std::tuple<Args...> t(args...);
+
+    return scanfields(p, t, std::make_index_sequence<nfields>{});
+  }
+
+  /* returns the end of the bits written */
+  template <class... Args>
+  std::size_t
+  print(void *bits, Args... args) const
+  {
+    static_assert(sizeof...(Args) == nargs,
+        "wrong number of arguments for the format");
+    std::uint8_t *p = static_cast<std::uint8_t *>(bits);
+    std::tuple<Args...> t(args...);
+
+    printfields(p, t, std::make_index_sequence<nfields>{});
+    return size;
+  }
+
+private:
+  template <class T, std::size_t... I>
+  static std::size_t
+  scanfields(const std::uint8_t *p, T &t, std::index_sequence<I...>)
+  {
+    std::size_t n = 0;
+    bool ok = true;
+
+    ((ok = ok && scanfield<I>(p, t, n)), ...);
+    return n;
+  }
+
+  template <class T, std::size_t... I>
+  static void
+  printfields(std::uint8_t *p, T &t, std::index_sequence<I...>)
+  {
+    (printfield<I>(p, t), ...);
+  }
+
+  template <std::size_t I>
+  static std::uint64_t
+  get(const std::uint8_t *p)
+  {
+    constexpr field f = layout::fields[I];
+    constexpr bool sign = f.type == 'c' || f.type == 's' || f.type == 'i' ||
+      f.type == 'l' || f.type == 'q';
+
+    return detail::getvalue<f.pos, f.nbits, f.byteorder, sign>(p);
+  }
+
+  template <std::size_t I>
+  static void
+  put(std::uint8_t *p, std::uint64_t v)
+  {
+    constexpr field f = layout::fields[I];
+
+    detail::putvalue<f.pos, f.nbits, f.byteorder>(p, v);
+  }
+
+  template <std::size_t I, class T>
+  static bool
+  scanfield(const std::uint8_t *p, T &t, std::size_t &n)
+  {
+    constexpr field f = layout::fields[I];
+    constexpr bool isfloat = f.type == 'f' || f.type == 'd';
+
+    if constexpr (f.valtype == literal::str) {
+      return detail::equalbytes<f.pos, f.nbits>(p,
+          S::value().data() + f.stroff);
+    } else if constexpr (f.valtype != literal::none) {
+      constexpr double d = f.valtype == literal::real ? f.fval :
+        f.valtype == literal::sint ? (double)f.ival : (double)f.uval;
+      constexpr std::uint64_t v = f.valtype == literal::real ?
+        (std::uint64_t)(long long)f.fval : f.uval;
+
+      if constexpr (f.type == '#' || f.type == 'A')
+        return true;
+      else if constexpr (isfloat || f.valtype == literal::real)
+        return isfloat && detail::tofloat<f.nbits>(get<I>(p)) == d;
+      else
+        return (get<I>(p) & detail::mask(f.nbits)) ==
+          (v & detail::mask(f.nbits));
+    } else if constexpr (f.type == '#') {
+      return true;
+    } else {
+      using V = typename detail::ctype<f.type>::type;
+      auto dest = std::get<layout::argindex(I)>(t);
+
+      static_assert(std::is_same_v<decltype(dest), V *>,
+          "argument type does not match the type specifier");
+      if constexpr (f.type == 'A')
+        detail::readbytes<f.pos, f.nbits>(p, dest);
+      else if constexpr (isfloat)
+        *dest = (V)detail::tofloat<f.nbits>(get<I>(p));
+      else if constexpr (f.type == '^')
+        *dest = reinterpret_cast<void *>((std::uintptr_t)get<I>(p));
+      else
+        *dest = (V)get<I>(p);
+      n++;
+      return true;
+    }
+  }
+
+  template <std::size_t I, class T>
+  static void
+  printfield(std::uint8_t *p, T &t)
+  {
+    constexpr field f = layout::fields[I];
+    constexpr bool isfloat = f.type == 'f' || f.type == 'd';
+
+    if constexpr (f.valtype == literal::str) {
+      detail::writebytes<f.pos, f.nbits>(p, S::value().data() + f.stroff);
+    } else if constexpr (f.type == '#') {
+      if constexpr (f.nbits > 0)
+        bitclear(p, f.pos, f.nbits);
+    } else if constexpr (f.valtype != literal::none) {
+      constexpr double d = f.valtype == literal::real ? f.fval :
+        f.valtype == literal::sint ? (double)f.ival : (double)f.uval;
+      constexpr std::uint64_t v = f.valtype == literal::real ?
+        (std::uint64_t)(long long)f.fval : f.uval;
+
+      if constexpr (isfloat)
+        put<I>(p, detail::fromfloat<f.nbits>(d));
+      else if constexpr (f.type != 'A')
+        put<I>(p, v);
+    } else {
+      using V = typename detail::ctype<f.type>::type;
+      auto src = std::get<layout::argindex(I)>(t);
+      using A = decltype(src);
+
+      if constexpr (f.type == 'A') {
+        static_assert(std::is_convertible_v<A, const char *>,
+            "'%A' takes a string");
+        std::size_t len = std::strlen(src) * 8;
+
+        if (len >= f.nbits) {
+          bitcpy(p, f.pos, src, 0, f.nbits);
+        } else {
+          bitcpy(p, f.pos, src, 0, len);
+          bitclear(p, f.pos + len, f.nbits - len);
+        }
+      } else if constexpr (f.type == '^') {
+        static_assert(std::is_pointer_v<A>, "'%^' takes a pointer");
+        put<I>(p, (std::uintptr_t)src);
+      } else if constexpr (isfloat) {
+        static_assert(std::is_arithmetic_v<A>, "'%f' takes a number");
+        put<I>(p, detail::fromfloat<f.nbits>((double)src));
+      } else {
+        static_assert(std::is_integral_v<A> || std::is_enum_v<A>,
+            "integer type specifier takes an integer");
+        put<I>(p, (std::uint64_t)(V)src);
+      }
+    }
+  }
+};
+
+} /* namespace bitscan */
+
+#define BITFORMAT(str)                                              \
+  ([] {                                                             \
+    struct bitformat_str {                                          \
+      static constexpr std::string_view value() { return str; }     \
+    };                                                              \
+    return ::bitscan::format<bitformat_str>{};                      \
+  }())
+
+/*
+ * lazy bit expressions (C++17)
+ *
+ *   bitscan::bitspan dst(p, 0, n);
+ *   bitscan::cbitspan a(q, 3, n), b(r, 0, n), c(s, 5, n);
+ *   dst = (a ^ b) & ~c.rotl(5);
+ *
+ * The operators only build a tree of small nodes, which is evaluated
+ * when it is assigned to a bitspan, a tile of 64 words of the result
+ * at a time, so every operand is read once and the only temporaries
+ * are a tile per node. An expression is as long as its shortest
+ * operand, and the destination is cleared past it. The shifts and
+ * rotations are those of bitlshift, bitrshift, bitlrotate and
+ * bitrrotate. If the destination overlaps an operand other than in
+ * place, the result is built aside first.
+ *
+ * bitview and bitand are taken by the C functions, hence the names.
+ */
+
+namespace bitscan {
+
+class cbitspan;
+
+namespace detail {
+
+template <class E> class rotexpr;
+
+/* words of the result evaluated at a time */
+constexpr std::size_t TILEWORDS = 64;
+
+inline std::uint64_t
+bigendian(std::uint64_t v)
+{
+  if (!littlehost)
+    return v;
+#ifdef __GNUC__
+  return __builtin_bswap64(v);
+#else
+  return swapbytes<64>(v);
+#endif
+}
+
+/* the 64 bits at q, most significant first */
+inline std::uint64_t
+loadbig(const std::uint8_t *q)
+{
+  std::uint64_t v;
+
+  std::memcpy(&v, q, 8);
+  return bigendian(v);
+}
+
+inline void
+storebig(std::uint8_t *q, std::uint64_t v)
+{
+  v = bigendian(v);
+  std::memcpy(q, &v, 8);
+}
+
+/* clears the bits of the nw words from off from the size on */
+inline void
+clip(std::uint64_t *w, std::size_t nw, std::size_t off, std::size_t size)
+{
+  std::size_t i = off < size ? (size - off) / 64 : 0;
+
+  if (i < nw && off < size && (size - off) % 64 != 0) {
+    w[i] &= ~(~(std::uint64_t)0 >> (size - off) % 64);
+    i++;
+  }
+  for (; i < nw; i++)
+    w[i] = 0;
+}
+
+} /* namespace detail */
+
+/*
+ * an expression fills nw words, at most TILEWORDS, with its bits from
+ * off by tile(off, nw, w); the bits from its size on are left unclear
+ * until they are moved or assigned
+ */
+template <class E>
+class bitexpr {
+public:
+  const E &
+  self() const
+  {
+    return static_cast<const E &>(*this);
+  }
+
+  /* the 64 bits from off */
+  std::uint64_t
+  word(std::size_t off) const
+  {
+    std::uint64_t w;
+
+    self().tile(off, 1, &w);
+    return w;
+  }
+
+  detail::rotexpr<E> rotl(std::size_t k) const;
+  detail::rotexpr<E> rotr(std::size_t k) const;
+};
+
+class cbitspan : public bitexpr<cbitspan> {
+public:
+  cbitspan(const void *bits, std::size_t pos, std::size_t size)
+    : p((const std::uint8_t *)bits), pos(pos), n(size) {}
+
+  std::size_t
+  size() const
+  {
+    return n;
+  }
+
+  void
+  tile(std::size_t off, std::size_t nw, std::uint64_t *w) const
+  {
+    std::size_t at = pos + off, end = (pos + n + 7) / 8, s = at % 8;
+    std::size_t m = 0, i, j, b;
+    const std::uint8_t *q = p + at / 8;
+    std::uint64_t v;
+
+    /* the words whose bytes are all in the bits */
+    if (off < n && at / 8 + 8 + (s != 0) <= end) {
+      m = (end - at / 8 - (s != 0)) / 8;
+      if (m > nw)
+        m = nw;
+    }
+    if (s == 0) {
+      for (i = 0; i < m; i++)
+        w[i] = detail::loadbig(q + 8 * i);
+    } else {
+      for (i = 0; i < m; i++)
+        w[i] = detail::loadbig(q + 8 * i) << s | q[8 * i + 8] >> (8 - s);
+    }
+    for (i = m; i < nw; i++) {
+      b = at / 8 + 8 * i;
+      if (off + 64 * i >= n) {
+        v = 0;
+      } else if (b + 8 <= end) {
+        v = detail::loadbig(p + b) << s;
+      } else {
+        for (j = 0, v = 0; j < 8; j++)
+          v = v << 8 | (b + j < end ? p[b + j] : 0);
+        v <<= s;
+      }
+      w[i] = v;
+    }
+  }
+
+  /*
+   * whether writing d a tile at a time would change these bits before
+   * they are read: if they overlap but are not in place, or are moved
+   */
+  bool
+  clobbers(const cbitspan &d, bool moved) const
+  {
+    const std::uint8_t *lo = p + pos / 8, *hi = p + (pos + n + 7) / 8;
+    const std::uint8_t *dlo = d.p + d.pos / 8;
+    const std::uint8_t *dhi = d.p + (d.pos + d.n + 7) / 8;
+
+    if (n == 0 || d.n == 0 || hi <= dlo || dhi <= lo)
+      return false;
+    return moved || lo != dlo || pos % 8 != d.pos % 8;
+  }
+
+protected:
+  const std::uint8_t *p;
+  std::size_t pos;
+  std::size_t n;
+};
+
+namespace detail {
+
+template <char Op, class L, class R>
+class binexpr : public bitexpr<binexpr<Op, L, R>> {
+public:
+  binexpr(const L &l, const R &r) : l(l), r(r) {}
+
+  std::size_t
+  size() const
+  {
+    return l.size() < r.size() ? l.size() : r.size();
+  }
+
+  void
+  tile(std::size_t off, std::size_t nw, std::uint64_t *w) const
+  {
+    std::uint64_t b[TILEWORDS];
+    std::size_t i;
+
+    l.tile(off, nw, w);
+    r.tile(off, nw, b);
+    for (i = 0; i < nw; i++) {
+      if constexpr (Op == '&')
+        w[i] &= b[i];
+      else if constexpr (Op == '|')
+        w[i] |= b[i];
+      else
+        w[i] ^= b[i];
+    }
+  }
+
+  bool
+  clobbers(const cbitspan &d, bool moved) const
+  {
+    return l.clobbers(d, moved) || r.clobbers(d, moved);
+  }
+
+private:
+  L l;
+  R r;
+};
+
+template <class E>
+class notexpr : public bitexpr<notexpr<E>> {
+public:
+  notexpr(const E &e) : e(e) {}
+
+  std::size_t
+  size() const
+  {
+    return e.size();
+  }
+
+  void
+  tile(std::size_t off, std::size_t nw, std::uint64_t *w) const
+  {
+    std::size_t i;
+
+    e.tile(off, nw, w);
+    for (i = 0; i < nw; i++)
+      w[i] = ~w[i];
+  }
+
+  bool
+  clobbers(const cbitspan &d, bool moved) const
+  {
+    return e.clobbers(d, moved);
+  }
+
+private:
+  E e;
+};
+
+template <class E>
+class shiftexpr : public bitexpr<shiftexpr<E>> {
+public:
+  shiftexpr(const E &e, std::size_t k, bool left) : e(e), k(k), left(left) {}
+
+  std::size_t
+  size() const
+  {
+    return e.size();
+  }
+
+  /* as bitrshift, the bits up to and including the k'th are cleared */
+  void
+  tile(std::size_t off, std::size_t nw, std::uint64_t *w) const
+  {
+    std::size_t i;
+
+    if (left || k == 0) {
+      /* the bits shifted in are clear */
+      e.tile(off + k, nw, w);
+      clip(w, nw, off + k, e.size());
+    } else if (off >= k) {
+      e.tile(off - k, nw, w);
+      if (off == k && nw > 0)
+        w[0] &= ~(std::uint64_t)0 >> 1;
+    } else {
+      for (i = 0; i < nw; i++)
+        w[i] = rword(off + 64 * i);
+    }
+  }
+
+  bool
+  clobbers(const cbitspan &d, bool) const
+  {
+    return e.clobbers(d, true);
+  }
+
+private:
+  E e;
+  std::size_t k;
+  bool left;
+
+  /* a word of the right shift */
+  std::uint64_t
+  rword(std::size_t off) const
+  {
+    std::uint64_t w;
+
+    if (k - off >= 63 && k >= off)
+      return 0;
+    w = off >= k ? e.word(off - k) : e.word(0) >> (k - off);
+    if (k >= off)
+      w &= ~(std::uint64_t)0 >> (k - off + 1);
+    return w;
+  }
+};
+
+template <class E>
+class rotexpr : public bitexpr<rotexpr<E>> {
+public:
+  rotexpr(const E &e, std::size_t k) : e(e), k(e.size() ? k % e.size() : 0) {}
+
+  std::size_t
+  size() const
+  {
+    return e.size();
+  }
+
+  void
+  tile(std::size_t off, std::size_t nw, std::uint64_t *w) const
+  {
+    std::uint64_t t[TILEWORDS];
+    std::size_t n = e.size(), j, m, d, i;
+
+    if (off >= n) {
+      for (i = 0; i < nw; i++)
+        w[i] = 0;
+      return;
+    }
+    j = off + k < n ? off + k : off + k - n;
+    /* the whole words before the bits wrap around to the start */
+    m = (n - j) / 64;
+    d = (n - j) % 64;
+    if (m >= nw) {
+      e.tile(j, nw, w);
+    } else if (d == 0) {
+      e.tile(j, m, w);
+      e.tile(0, nw - m, w + m);
+    } else {
+      /* the rest follows the last d bits */
+      e.tile(j, m + 1, w);
+      clip(w, m + 1, j, n);
+      e.tile(0, nw - m, t);
+      w[m] |= t[0] >> d;
+      for (i = m + 1; i < nw; i++)
+        w[i] = t[i - m - 1] << (64 - d) | t[i - m] >> d;
+    }
+  }
+
+  bool
+  clobbers(const cbitspan &d, bool) const
+  {
+    return e.clobbers(d, true);
+  }
+
+private:
+  E e;
+  std::size_t k;
+};
+
+} /* namespace detail */
+
+template <class E>
+detail::rotexpr<E>
+bitexpr<E>::rotl(std::size_t k) const
+{
+  return detail::rotexpr<E>(self(), k);
+}
+
+template <class E>
+detail::rotexpr<E>
+bitexpr<E>::rotr(std::size_t k) const
+{
+  std::size_t n = self().size();
+
+  return detail::rotexpr<E>(self(), n ? n - k % n : 0);
+}
+
+template <class L, class R>
+inline detail::binexpr<'&', L, R>
+operator&(const bitexpr<L> &l, const bitexpr<R> &r)
+{
+  return detail::binexpr<'&', L, R>(l.self(), r.self());
+}
+
+template <class L, class R>
+inline detail::binexpr<'|', L, R>
+operator|(const bitexpr<L> &l, const bitexpr<R> &r)
+{
+  return detail::binexpr<'|', L, R>(l.self(), r.self());
+}
+
+template <class L, class R>
+inline detail::binexpr<'^', L, R>
+operator^(const bitexpr<L> &l, const bitexpr<R> &r)
+{
+  return detail::binexpr<'^', L, R>(l.self(), r.self());
+}
+
+template <class E>
+inline detail::notexpr<E>
+operator~(const bitexpr<E> &e)
+{
+  return detail::notexpr<E>(e.self());
+}
+
+template <class E>
+inline detail::shiftexpr<E>
+operator<<(const bitexpr<E> &e, std::size_t k)
+{
+  return detail::shiftexpr<E>(e.self(), k, true);
+}
+
+template <class E>
+inline detail::shiftexpr<E>
+operator>>(const bitexpr<E> &e, std::size_t k)
+{
+  return detail::shiftexpr<E>(e.self(), k, false);
+}
+
+/*
+ * bits which expressions are assigned to. Assigning a bitspan writes
+ * its bits as any expression, so it cannot be copied to refer to the
+ * same bits; make another bitspan of the bits instead.
+ */
+class bitspan : public cbitspan {
+public:
+  bitspan(void *bits, std::size_t pos, std::size_t size)
+    : cbitspan(bits, pos, size) {}
+  bitspan(const bitspan &) = delete;
+
+  bitspan &
+  operator=(const bitspan &s)
+  {
+    return *this = static_cast<const bitexpr<cbitspan> &>(s);
+  }
+
+  template <class E>
+  bitspan &
+  operator=(const bitexpr<E> &e)
+  {
+    std::unique_ptr<std::uint8_t[]> buf;
+
+    if (e.self().clobbers(*this, false)) {
+      buf.reset(new std::uint8_t[n / 8 + 1]);
+      bitspan(buf.get(), 0, n).write(e.self());
+      write(cbitspan(buf.get(), 0, n));
+    } else {
+      write(e.self());
+    }
+    return *this;
+  }
+
+private:
+  template <class E>
+  void
+  write(const E &e)
+  {
+    std::uint8_t *d = const_cast<std::uint8_t *>(p) + pos / 8, m;
+    std::uint64_t w[detail::TILEWORDS];
+    std::size_t off = 0, nw, i;
+
+    if (pos % 8 != 0 && n > 0) {
+      off = 8 - pos % 8 < n ? 8 - pos % 8 : n;
+      m = (std::uint8_t)(0xff >> pos % 8 & 0xff << (8 - pos % 8 - off));
+      e.tile(0, 1, w);
+      detail::clip(w, 1, 0, e.size());
+      *d = (std::uint8_t)((*d & ~m) | (w[0] >> 56 >> pos % 8 & m));
+      d++;
+    }
+    for (; n - off >= 64; off += 64 * nw, d += 8 * nw) {
+      nw = (n - off) / 64;
+      if (nw > detail::TILEWORDS)
+        nw = detail::TILEWORDS;
+      e.tile(off, nw, w);
+      detail::clip(w, nw, off, e.size());
+      for (i = 0; i < nw; i++)
+        detail::storebig(d + 8 * i, w[i]);
+    }
+    if (off < n) {
+      e.tile(off, 1, w);
+      detail::clip(w, 1, off, e.size());
+      for (i = 0; off + 8 * i + 8 <= n; i++)
+        d[i] = (std::uint8_t)(w[0] >> (56 - 8 * i));
+      if ((n - off) % 8 != 0) {
+        m = (std::uint8_t)(0xff << (8 - (n - off) % 8));
+        d[i] = (std::uint8_t)((d[i] & ~m) | (w[0] >> (56 - 8 * i) & m));
+      }
+    }
+  }
+};
+
+} /* namespace bitscan */
+
+#endif /* __BITSCAN_HPP__ */
@@ -3,29 +3,53 @@
 #include <time.h>
 #include "test.h"
 
+extern void inittestbitbatch();
 extern void inittestbitcmp();
+extern void inittestbitcount();
 extern void inittestbitget();
+extern void inittestbitmap();
+extern void inittestbitmatch();
+extern void inittestbitnext();
 extern void inittestbitset();
 extern void inittestbitrand();
+extern void inittestbitrank();
 extern void inittestbitclear();
 extern void inittestbitcpy();
+extern void inittestbitexpr();
+extern void inittestbitfill();
+extern void inittestbitfind();
+extern void inittestbitformat();
 extern void inittestbitop();
 extern void inittestbitrotate();
+extern void inittestbitscanf();
 extern void inittestbitshift();
+extern void inittestbitview();
 
 int
 main(int argc, char **argv)
 {
   srand((unsigned int)time(NULL));
+  inittestbitbatch();
   inittestbitclear();
   inittestbitcmp();
+  inittestbitcount();
   inittestbitcpy();
+  inittestbitexpr();
+  inittestbitfill();
+  inittestbitfind();
+  inittestbitformat();
   inittestbitget();
+  inittestbitmap();
+  inittestbitmatch();
+  inittestbitnext();
   inittestbitop();
   inittestbitrand();
+  inittestbitrank();
   inittestbitrotate();
+  inittestbitscanf();
   inittestbitset();
   inittestbitshift();
+  inittestbitview();
   testrun();
   return 0;
 }
@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+#define FORMAT \
+  "%C:5 %s<:16 'x'%C %I>:23 %Q@70:61 %d< %A:20 -3%i:7 %L<:40 %f@256"
+#define LAYOUTSIZE  288
+
+struct testdata {
+  size_t pos;
+  size_t stride;
+  size_t count;
+  size_t broken;
+  bool flag;
+};
+
+static void **
+datatestbitbatchscanf()
+{
+  struct testdata **data;
+  static size_t n = 2000, maxcount = 100;
+  size_t i;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    data[i]->pos = (size_t)(abs(rand()) % 64);
+    data[i]->stride = LAYOUTSIZE + (size_t)(abs(rand()) % 100);
+    data[i]->count = (size_t)(abs(rand()) % maxcount) + 1;
+    data[i]->broken = (size_t)(abs(rand()) % (data[i]->count * 2));
+    data[i]->flag = (bool)(abs(random() % 2));
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitbatchscanf(void *data)
+{
+  /* do nothing */
+}
+
+struct record {
+  unsigned char c;
+  short s;
+  unsigned int u;
+  unsigned long long q;
+  double d;
+  char a[4];
+  unsigned long l;
+  float f;
+};
+
+static uint64_t
+gen64()
+{
+  return (uint64_t)random() << 33 ^ (uint64_t)random() << 11 ^
+    (uint64_t)random();
+}
+
+static void
+testbitbatchscanf(void *data)
+{
+  struct testdata *test;
+  struct record *recs, r;
+  uint8_t *buf;
+  unsigned char *c;
+  short *s;
+  unsigned int *u;
+  unsigned long long *q;
+  double *d;
+  char *a;
+  unsigned long *l;
+  float *f;
+  size_t i, n, capa, expect;
+
+  test = data;
+  capa = (test->pos + test->stride * test->count + 7) / 8;
+  buf = (uint8_t *)malloc(capa);
+  memset(buf, test->flag ? 0xff : 0, capa);
+  recs = (struct record *)calloc(test->count, sizeof(struct record));
+  c = (unsigned char *)malloc(test->count);
+  s = (short *)malloc(sizeof(short) * test->count);
+  u = (unsigned int *)malloc(sizeof(unsigned int) * test->count);
+  q = (unsigned long long *)malloc(sizeof(unsigned long long) * test->count);
+  d = (double *)malloc(sizeof(double) * test->count);
+  a = (char *)malloc(3 * test->count);
+  l = (unsigned long *)malloc(sizeof(unsigned long) * test->count);
+  f = (float *)malloc(sizeof(float) * test->count);
+
+  for (i = 0; i < test->count; i++) {
+    recs[i].a[0] = 'a' + random() % 26;
+    recs[i].a[1] = 'a' + random() % 26;
+    recs[i].a[2] = 'a' + random() % 26;
+    bitsprintf(buf, test->pos + i * test->stride, FORMAT,
+        (int)random(), (int)random(), (unsigned int)gen64(),
+        (unsigned long long)gen64(), (double)random() / 64, recs[i].a,
+        (unsigned long)gen64(), (double)random() / 4);
+    bitsscanf(buf, test->pos + i * test->stride, FORMAT,
+        &recs[i].c, &recs[i].s, &recs[i].u, &recs[i].q, &recs[i].d,
+        recs[i].a, &recs[i].l, &recs[i].f);
+  }
+
+  /* a wrong literal stops the batch */
+  expect = test->count;
+  if (test->broken < test->count) {
+    bitset(buf, test->pos + test->broken * test->stride + 23,
+        !bitget(buf, test->pos + test->broken * test->stride + 23));
+    expect = test->broken;
+  }
+
+  n = bitbatchscanf(buf, test->pos, test->stride, test->count, FORMAT,
+      c, s, u, q, d, a, l, f);
+  if (n != expect) {
+    testassert(false, "wrong number of records");
+    goto error;
+  }
+
+  for (i = 0; i < n; i++) {
+    r = recs[i];
+    if (c[i] != r.c || s[i] != r.s || u[i] != r.u || q[i] != r.q ||
+        d[i] != r.d || !biteq(a + i * 3, 0, r.a, 0, 20) || l[i] != r.l ||
+        f[i] != r.f) {
+      testassert(false, "wrong field values");
+      goto error;
+    }
+  }
+
+  testassert(true, NULL);
+
+error:
+  free(buf);
+  free(recs);
+  free(c);
+  free(s);
+  free(u);
+  free(q);
+  free(d);
+  free(a);
+  free(l);
+  free(f);
+}
+
+void
+inittestbitbatch()
+{
+  TESTADD(testbitbatchscanf);
+}
@@ -13,6 +13,7 @@ struct testdata {
   size_t size;
   size_t capa;
   int expected;
+  size_t mismatch;
 };
 
 void **
@@ -36,27 +37,36 @@ datatestbitcmp()
     memset(data[i]->bytes1, 0, data[i]->capa);
     memset(data[i]->bytes2, 0, data[i]->capa);
 
-    if (rand() % 2 == 0) {
+    switch (rand() % 3) {
+    case 0:
       /* same bits */
-      data[i]->expected = 0;
       bitstdrand(data[i]->bytes1, data[i]->pos1, data[i]->size);
       bitcpy(data[i]->bytes2, data[i]->pos2,
           data[i]->bytes1, data[i]->pos1, data[i]->size);
-    } else {
+      break;
+    case 1:
+      /* one different bit */
+      bitstdrand(data[i]->bytes1, data[i]->pos1, data[i]->size);
+      bitcpy(data[i]->bytes2, data[i]->pos2,
+          data[i]->bytes1, data[i]->pos1, data[i]->size);
+      j = data[i]->pos2 + (size_t)(abs(rand()) % data[i]->size);
+      bitset(data[i]->bytes2, j, !bitget(data[i]->bytes2, j));
+      break;
+    default:
       bitstdrand(data[i]->bytes1, data[i]->pos1, data[i]->size);
       bitstdrand(data[i]->bytes2, data[i]->pos2, data[i]->size);
+      break;
+    }
 
-      data[i]->expected = 0;
-      for (j = 0; j < data[i]->size; j++) {
-        b1 = bitget(data[i]->bytes1, data[i]->pos1 + j);
-        b2 = bitget(data[i]->bytes2, data[i]->pos2 + j);
-        if (b1 > b2) {
-          data[i]->expected = 1;
-          break;
-        } else if (b1 < b2) {
-          data[i]->expected = -1;
-          break;
-        }
+    data[i]->expected = 0;
+    data[i]->mismatch = data[i]->size;
+    for (j = 0; j < data[i]->size; j++) {
+      b1 = bitget(data[i]->bytes1, data[i]->pos1 + j);
+      b2 = bitget(data[i]->bytes2, data[i]->pos2 + j);
+      if (b1 != b2) {
+        data[i]->expected = b1 > b2 ? 1 : -1;
+        data[i]->mismatch = j;
+        break;
       }
     }
   }
@@ -96,10 +106,23 @@ testbiteq(void *data)
       "test failed");
 }
 
+void
+testbitmismatch(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  testassert(bitmismatch(test->bytes1, test->pos1,
+        test->bytes2, test->pos2, test->size) == test->mismatch,
+      "test failed");
+}
+
 void
 inittestbitcmp()
 {
   TESTADD(testbitcmp);
   testadd("testbiteq", datatestbitcmp, testbiteq, freetestbitcmp);
+  testadd("testbitmismatch", datatestbitcmp, testbitmismatch,
+      freetestbitcmp);
 }
 
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  uint8_t *bytes1;
+  uint8_t *bytes2;
+  size_t pos1;
+  size_t pos2;
+  size_t size;
+  size_t count;
+  size_t andcount;
+  size_t orcount;
+  size_t xorcount;
+};
+
+static void **
+datatestbitcount()
+{
+  struct testdata **data;
+  static size_t n = 5000, maxcapa = 2048;
+  size_t i, j, capa;
+  bool f1, f2;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    capa = gencapa(maxcapa);
+    data[i]->size = gensize(capa);
+    data[i]->pos1 = genpos(capa, data[i]->size);
+    data[i]->pos2 = genpos(capa, data[i]->size);
+    data[i]->bytes1 = (uint8_t *)malloc(capa);
+    data[i]->bytes2 = (uint8_t *)malloc(capa);
+    bitstdrand(data[i]->bytes1, 0, capa * 8);
+    bitstdrand(data[i]->bytes2, 0, capa * 8);
+
+    data[i]->count = 0;
+    data[i]->andcount = 0;
+    data[i]->orcount = 0;
+    data[i]->xorcount = 0;
+    for (j = 0; j < data[i]->size; j++) {
+      f1 = bitget(data[i]->bytes1, data[i]->pos1 + j);
+      f2 = bitget(data[i]->bytes2, data[i]->pos2 + j);
+      data[i]->count += f1;
+      data[i]->andcount += f1 & f2;
+      data[i]->orcount += f1 | f2;
+      data[i]->xorcount += f1 ^ f2;
+    }
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitcount(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  free(test->bytes1);
+  free(test->bytes2);
+}
+
+static void
+testbitcount(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  testassert(bitcount(test->bytes1, test->pos1, test->size) == test->count,
+      "test failed");
+}
+
+static void
+testbitandcount(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  testassert(bitandcount(test->bytes1, test->pos1,
+        test->bytes2, test->pos2, test->size) == test->andcount,
+      "test failed");
+}
+
+static void
+testbitorcount(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  testassert(bitorcount(test->bytes1, test->pos1,
+        test->bytes2, test->pos2, test->size) == test->orcount,
+      "test failed");
+}
+
+static void
+testbitxorcount(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  testassert(bitxorcount(test->bytes1, test->pos1,
+        test->bytes2, test->pos2, test->size) == test->xorcount,
+      "test failed");
+}
+
+void
+inittestbitcount()
+{
+  TESTADD(testbitcount);
+  testadd("testbitandcount", datatestbitcount, testbitandcount,
+      freetestbitcount);
+  testadd("testbitorcount", datatestbitcount, testbitorcount,
+      freetestbitcount);
+  testadd("testbitxorcount", datatestbitcount, testbitxorcount,
+      freetestbitcount);
+}
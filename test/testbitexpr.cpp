@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.hpp"
+#include "test.h"
+#include "testgen.h"
+
+using bitscan::bitspan;
+using bitscan::cbitspan;
+
+static_assert(!std::is_copy_constructible_v<bitspan>,
+    "a copy of a bitspan would not write the bits");
+
+struct testdata {
+  size_t capa;
+  uint8_t *bytes[3];
+  size_t pos[3];
+  size_t size;
+  uint8_t *dest;
+  size_t destpos;
+  size_t k;
+};
+
+static void **
+datatestbitexpr()
+{
+  struct testdata **data;
+  static size_t n = 3000, maxcapa = 300;
+  size_t i, j;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    data[i]->capa = gencapa(maxcapa);
+    data[i]->size = gensize(data[i]->capa);
+    data[i]->destpos = genpos(data[i]->capa, data[i]->size);
+    data[i]->dest = (uint8_t *)malloc(data[i]->capa);
+    bitstdrand(data[i]->dest, 0, data[i]->capa * 8);
+    for (j = 0; j < 3; j++) {
+      data[i]->bytes[j] = (uint8_t *)malloc(data[i]->capa);
+      data[i]->pos[j] = genpos(data[i]->capa, data[i]->size);
+      bitstdrand(data[i]->bytes[j], 0, data[i]->capa * 8);
+    }
+    data[i]->k = (size_t)rand() % (data[i]->size + 70);
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitexpr(void *data)
+{
+  struct testdata *test;
+  size_t j;
+
+  test = (struct testdata *)data;
+  for (j = 0; j < 3; j++)
+    free(test->bytes[j]);
+  free(test->dest);
+}
+
+static bool
+bitof(const struct testdata *test, size_t j, size_t i)
+{
+  return bitget(test->bytes[j], test->pos[j] + i);
+}
+
+/* bit i of the operand j shifted or rotated as in the C functions */
+static bool
+movedbit(const struct testdata *test, size_t j, size_t i, char how)
+{
+  size_t n = test->size, k = test->k;
+
+  switch (how) {
+  case '<':
+    return i + k < n && bitof(test, j, i + k);
+  case '>':
+    if (k == 0)
+      return bitof(test, j, i);
+    return i > k && bitof(test, j, i - k);
+  case 'l':
+    return bitof(test, j, (i + k % n) % n);
+  default:
+    return bitof(test, j, (i + n - k % n) % n);
+  }
+}
+
+/* whether dest has the bits of f and is unchanged elsewhere */
+template <class F>
+static bool
+checkbitexpr(const struct testdata *test, const uint8_t *dest,
+    size_t destpos, F f)
+{
+  uint8_t *expected;
+  size_t i;
+  bool same;
+
+  expected = (uint8_t *)malloc(test->capa);
+  memcpy(expected, test->dest, test->capa);
+  for (i = 0; i < test->size; i++)
+    bitset(expected, destpos + i, f(i));
+  same = memcmp(dest, expected, test->capa) == 0;
+  free(expected);
+  return same;
+}
+
+static void
+testbitexpr(void *data)
+{
+  struct testdata *test;
+  uint8_t *buf;
+  size_t n;
+
+  test = (struct testdata *)data;
+  n = test->size;
+  cbitspan a(test->bytes[0], test->pos[0], n);
+  cbitspan b(test->bytes[1], test->pos[1], n);
+  cbitspan c(test->bytes[2], test->pos[2], n);
+  buf = (uint8_t *)malloc(test->capa);
+  bitspan dest(buf, test->destpos, n);
+
+  memcpy(buf, test->dest, test->capa);
+  dest = (a ^ b) & ~c.rotl(test->k);
+  testassert(checkbitexpr(test, buf, test->destpos, [&](size_t i) {
+        return (bitof(test, 0, i) ^ bitof(test, 1, i)) &
+          !movedbit(test, 2, i, 'l');
+      }), "failed to write (a ^ b) & ~c.rotl(k)");
+
+  memcpy(buf, test->dest, test->capa);
+  dest = (a | b) << test->k;
+  testassert(checkbitexpr(test, buf, test->destpos, [&](size_t i) {
+        return movedbit(test, 0, i, '<') | movedbit(test, 1, i, '<');
+      }), "failed to write (a | b) << k");
+
+  memcpy(buf, test->dest, test->capa);
+  dest = ~(a >> test->k) ^ c.rotr(test->k);
+  testassert(checkbitexpr(test, buf, test->destpos, [&](size_t i) {
+        return !movedbit(test, 0, i, '>') ^ movedbit(test, 2, i, 'r');
+      }), "failed to write ~(a >> k) ^ c.rotr(k)");
+
+  /* shorter operands, and the destination cleared past them */
+  memcpy(buf, test->dest, test->capa);
+  dest = a & cbitspan(test->bytes[1], test->pos[1], n / 2);
+  testassert(checkbitexpr(test, buf, test->destpos, [&](size_t i) {
+        return i < n / 2 && bitof(test, 0, i) & bitof(test, 1, i);
+      }), "failed to write a shorter expression");
+
+  /* a bitspan assigned writes its bits */
+  memcpy(buf, test->dest, test->capa);
+  bitspan src(test->bytes[0], test->pos[0], n);
+  dest = src;
+  testassert(checkbitexpr(test, buf, test->destpos, [&](size_t i) {
+        return bitof(test, 0, i);
+      }), "failed to write a bitspan");
+
+  free(buf);
+}
+
+static void
+testbitexprinplace(void *data)
+{
+  struct testdata *test;
+  uint8_t *buf, *expected;
+  size_t n, pos, i;
+
+  test = (struct testdata *)data;
+  n = test->size;
+  pos = test->pos[0];
+  buf = (uint8_t *)malloc(test->capa);
+  memcpy(buf, test->dest, test->capa);
+  bitcpy(buf, pos, test->bytes[0], pos, n);
+  bitspan dest(buf, pos, n);
+  cbitspan b(test->bytes[1], test->pos[1], n);
+
+  /* dest in place, then moved, which is built aside */
+  dest = dest ^ b;
+  dest = dest.rotl(test->k);
+  testassert(checkbitexpr(test, buf, pos, [&](size_t i) {
+        size_t j = (i + test->k % n) % n;
+
+        return bitof(test, 0, j) ^ bitof(test, 1, j);
+      }), "failed to write in place");
+
+  /* overlapping at another position */
+  memcpy(buf, test->dest, test->capa);
+  bitcpy(buf, pos, test->bytes[0], pos, n);
+  expected = (uint8_t *)malloc(test->capa);
+  memcpy(expected, buf, test->capa);
+  for (i = 0; i < n; i++)
+    bitset(expected, test->destpos + i, movedbit(test, 0, i, '>'));
+  bitspan(buf, test->destpos, n) = cbitspan(buf, pos, n) >> test->k;
+  testassert(memcmp(buf, expected, test->capa) == 0,
+      "failed to write over the operand");
+
+  free(expected);
+  free(buf);
+}
+
+extern "C" void
+inittestbitexpr()
+{
+  TESTADD(testbitexpr);
+  testadd("testbitexprinplace", datatestbitexpr, testbitexprinplace,
+      freetestbitexpr);
+}
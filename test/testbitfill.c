@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  size_t capa;
+  size_t pos;
+  size_t size;
+  uint64_t pattern;
+  size_t patternbits;
+  bool flag;
+};
+
+static void **
+datatestbitfill()
+{
+  struct testdata **data;
+  static size_t n = 10000, maxcapa = 1024;
+  size_t i;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    data[i]->capa = gencapa(maxcapa);
+    data[i]->size = gensize(data[i]->capa);
+    data[i]->pos = genpos(data[i]->capa, data[i]->size);
+    data[i]->pattern = (uint64_t)random() << 33 ^ (uint64_t)random() << 11 ^
+      (uint64_t)random();
+    data[i]->patternbits = (size_t)(abs(rand()) % 64) + 1;
+    data[i]->flag = (bool)(abs(random() % 2));
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitfill(void *data)
+{
+  /* do nothing */
+}
+
+static void
+testbitfill(void *data)
+{
+  struct testdata *test;
+  uint8_t *buf;
+  size_t i, k;
+  bool f;
+
+  test = data;
+  buf = (uint8_t *)malloc(test->capa);
+  memset(buf, test->flag ? 0xff : 0, test->capa);
+  bitfill(buf, test->pos, test->size, test->pattern, test->patternbits);
+
+  for (i = 0; i < test->pos; i++) {
+    if (bitget(buf, i) != test->flag) {
+      testassert(false, "bits between 0 and pos are modified");
+      goto error;
+    }
+  }
+
+  for (i = 0; i < test->size; i++) {
+    k = test->patternbits - i % test->patternbits - 1;
+    f = (bool)((test->pattern >> k) & 1);
+    if (bitget(buf, test->pos + i) != f) {
+      testassert(false, "wrong pattern");
+      goto error;
+    }
+  }
+
+  for (i = test->pos + test->size; i < test->capa * 8; i++) {
+    if (bitget(buf, i) != test->flag) {
+      testassert(false, "rest bits are modified");
+      goto error;
+    }
+  }
+
+  free(buf);
+  testassert(true, NULL);
+  return;
+
+error:
+  free(buf);
+}
+
+void
+inittestbitfill()
+{
+  TESTADD(testbitfill);
+}
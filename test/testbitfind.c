@@ -0,0 +1,378 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  uint8_t *bytes;
+  size_t pos;
+  size_t size;
+  uint8_t *needle;
+  size_t npos;
+  size_t nsize;
+  size_t expected;
+};
+
+/* few distinct bits, so that needles nearly match in many places */
+static void
+sparserand(uint8_t *bytes, size_t pos, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    bitset(bytes, pos + i, rand() % 16 == 0);
+}
+
+static void **
+datatestbitfind()
+{
+  struct testdata **data;
+  static size_t n = 10000, maxcapa = 300, maxneedle = 200;
+  size_t i, j, capa, ncapa;
+  bool sparse;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    capa = gencapa(maxcapa);
+    data[i]->bytes = (uint8_t *)malloc(capa);
+    data[i]->size = gensize(capa);
+    data[i]->pos = genpos(capa, data[i]->size);
+    sparse = genbool();
+    memset(data[i]->bytes, 0, capa);
+    if (sparse)
+      sparserand(data[i]->bytes, data[i]->pos, data[i]->size);
+    else
+      bitstdrand(data[i]->bytes, data[i]->pos, data[i]->size);
+
+    /* mostly short needles, which take the word paths */
+    if (rand() % 4 == 0)
+      data[i]->nsize = 65 + (size_t)(rand() % (maxneedle - 64));
+    else
+      data[i]->nsize = 1 + (size_t)(rand() % 64);
+    ncapa = (data[i]->nsize + 7) / 8 + 1;
+    data[i]->needle = (uint8_t *)malloc(ncapa);
+    data[i]->npos = genpos(ncapa, data[i]->nsize);
+    memset(data[i]->needle, 0, ncapa);
+
+    switch (rand() % 3) {
+    case 0:
+      /* taken from the haystack */
+      if (data[i]->nsize <= data[i]->size) {
+        j = (size_t)rand() % (data[i]->size - data[i]->nsize + 1);
+        bitcpy(data[i]->needle, data[i]->npos,
+            data[i]->bytes, data[i]->pos + j, data[i]->nsize);
+        break;
+      }
+      /* fall through */
+    case 1:
+      /* taken from the haystack with one bit flipped */
+      if (data[i]->nsize <= data[i]->size) {
+        j = (size_t)rand() % (data[i]->size - data[i]->nsize + 1);
+        bitcpy(data[i]->needle, data[i]->npos,
+            data[i]->bytes, data[i]->pos + j, data[i]->nsize);
+        j = data[i]->npos + (size_t)rand() % data[i]->nsize;
+        bitset(data[i]->needle, j, !bitget(data[i]->needle, j));
+        break;
+      }
+      /* fall through */
+    default:
+      if (sparse)
+        sparserand(data[i]->needle, data[i]->npos, data[i]->nsize);
+      else
+        bitstdrand(data[i]->needle, data[i]->npos, data[i]->nsize);
+      break;
+    }
+
+    data[i]->expected = data[i]->size;
+    for (j = 0; j + data[i]->nsize <= data[i]->size; j++) {
+      if (biteq(data[i]->bytes, data[i]->pos + j,
+            data[i]->needle, data[i]->npos, data[i]->nsize)) {
+        data[i]->expected = j;
+        break;
+      }
+    }
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitfind(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  free(test->bytes);
+  free(test->needle);
+}
+
+static void
+testbitfind(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  testassert(bitfind(test->bytes, test->pos, test->size,
+        test->needle, test->npos, test->nsize) == test->expected,
+      "test failed");
+}
+
+struct approxdata {
+  uint8_t *bytes;
+  size_t pos;
+  size_t size;
+  uint8_t *needle;
+  size_t npos;
+  size_t nsize;
+  size_t maxerrors;
+  size_t nhits;
+  size_t *hits;
+};
+
+static void **
+datatestbitfindapprox()
+{
+  struct approxdata **data;
+  static size_t n = 3000, maxcapa = 256, maxneedle = 150;
+  size_t i, j, k, capa, errors;
+  struct approxdata *d;
+
+  data = (struct approxdata **)malloc(sizeof(struct approxdata *) * (n+1));
+  data[n] = NULL;
+  for (i = 0; i < n; i++) {
+    d = data[i] = (struct approxdata *)malloc(sizeof(struct approxdata));
+    capa = gencapa(maxcapa);
+    d->bytes = (uint8_t *)calloc(capa, 1);
+    d->size = gensize(capa);
+    d->pos = genpos(capa, d->size);
+    if (genbool())
+      sparserand(d->bytes, d->pos, d->size);
+    else
+      bitstdrand(d->bytes, d->pos, d->size);
+
+    if (rand() % 4 == 0)
+      d->nsize = 1 + (size_t)rand() % maxneedle;
+    else
+      d->nsize = 1 + (size_t)rand() % 56;
+    d->needle = (uint8_t *)calloc(maxneedle / 8 + 2, 1);
+    d->npos = (size_t)rand() % 8;
+    d->maxerrors = (size_t)rand() % (d->nsize / 4 + 1);
+    if (d->nsize <= d->size && genbool()) {
+      /* taken from the haystack with a few bits flipped */
+      k = (size_t)rand() % (d->size - d->nsize + 1);
+      bitcpy(d->needle, d->npos, d->bytes, d->pos + k, d->nsize);
+      for (j = (size_t)rand() % (d->maxerrors + 2); j > 0; j--) {
+        k = d->npos + (size_t)rand() % d->nsize;
+        bitset(d->needle, k, !bitget(d->needle, k));
+      }
+    } else {
+      bitstdrand(d->needle, d->npos, d->nsize);
+    }
+
+    d->nhits = 0;
+    d->hits = (size_t *)malloc(sizeof(size_t) * (d->size + 1));
+    for (k = 0; k + d->nsize <= d->size; k++) {
+      errors = 0;
+      for (j = 0; j < d->nsize; j++) {
+        errors += bitget(d->bytes, d->pos + k + j) !=
+          bitget(d->needle, d->npos + j);
+      }
+      if (errors <= d->maxerrors)
+        d->hits[d->nhits++] = k;
+    }
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitfindapprox(void *data)
+{
+  struct approxdata *test;
+
+  test = (struct approxdata *)data;
+  free(test->bytes);
+  free(test->needle);
+  free(test->hits);
+}
+
+static void
+testbitfindapprox(void *data)
+{
+  struct approxdata *test;
+  size_t nhits, offset, r;
+  bool same;
+
+  test = (struct approxdata *)data;
+  nhits = 0;
+  same = true;
+  for (offset = 0; offset <= test->size; offset += r + 1) {
+    r = bitfindapprox(test->bytes, test->pos + offset, test->size - offset,
+        test->needle, test->npos, test->nsize, test->maxerrors);
+    if (r == test->size - offset)
+      break;
+    if (nhits >= test->nhits || test->hits[nhits] != offset + r)
+      same = false;
+    nhits++;
+  }
+  testassert(same && nhits == test->nhits, "test failed");
+}
+
+struct finderdata {
+  uint8_t *bytes;
+  size_t pos;
+  size_t size;
+  size_t count;
+  uint8_t **needles;
+  size_t *npos;
+  size_t *nsizes;
+  size_t nhits;
+  size_t *hits;         /* pairs of offset and needle in order */
+};
+
+static int
+cmphit(const void *a, const void *b)
+{
+  const size_t *x = (const size_t *)a, *y = (const size_t *)b;
+
+  if (x[0] != y[0])
+    return x[0] < y[0] ? -1 : 1;
+  else if (x[1] != y[1])
+    return x[1] < y[1] ? -1 : 1;
+  return 0;
+}
+
+static void **
+datatestbitfinder()
+{
+  struct finderdata **data;
+  static size_t n = 1000, maxcapa = 256, maxcount = 40, maxneedle = 40;
+  size_t i, j, k, capa;
+  struct finderdata *d;
+
+  data = (struct finderdata **)malloc(sizeof(struct finderdata *) * (n+1));
+  data[n] = NULL;
+  for (i = 0; i < n; i++) {
+    d = data[i] = (struct finderdata *)malloc(sizeof(struct finderdata));
+    capa = gencapa(maxcapa);
+    d->bytes = (uint8_t *)calloc(capa, 1);
+    d->size = gensize(capa);
+    d->pos = genpos(capa, d->size);
+    if (genbool())
+      sparserand(d->bytes, d->pos, d->size);
+    else
+      bitstdrand(d->bytes, d->pos, d->size);
+
+    d->count = (size_t)rand() % maxcount;
+    d->needles = (uint8_t **)malloc(sizeof(uint8_t *) * (d->count + 1));
+    d->npos = (size_t *)malloc(sizeof(size_t) * (d->count + 1));
+    d->nsizes = (size_t *)malloc(sizeof(size_t) * (d->count + 1));
+    for (j = 0; j < d->count; j++) {
+      d->nsizes[j] = 1 + (size_t)rand() % maxneedle;
+      d->needles[j] = (uint8_t *)calloc(maxneedle / 8 + 2, 1);
+      d->npos[j] = (size_t)rand() % 8;
+      if (j > 0 && rand() % 8 == 0) {
+        /* a duplicate or a prefix of another needle */
+        k = (size_t)rand() % j;
+        if (d->nsizes[j] > d->nsizes[k])
+          d->nsizes[j] = d->nsizes[k];
+        bitcpy(d->needles[j], d->npos[j],
+            d->needles[k], d->npos[k], d->nsizes[j]);
+      } else if (d->nsizes[j] <= d->size && genbool()) {
+        k = (size_t)rand() % (d->size - d->nsizes[j] + 1);
+        bitcpy(d->needles[j], d->npos[j],
+            d->bytes, d->pos + k, d->nsizes[j]);
+      } else {
+        bitstdrand(d->needles[j], d->npos[j], d->nsizes[j]);
+      }
+    }
+
+    d->nhits = 0;
+    d->hits = (size_t *)malloc(sizeof(size_t) * 2 * (d->size * d->count + 1));
+    for (k = 0; k < d->size; k++) {
+      for (j = 0; j < d->count; j++) {
+        if (k + d->nsizes[j] <= d->size &&
+            biteq(d->bytes, d->pos + k,
+              d->needles[j], d->npos[j], d->nsizes[j])) {
+          d->hits[d->nhits * 2] = k;
+          d->hits[d->nhits * 2 + 1] = j;
+          d->nhits++;
+        }
+      }
+    }
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitfinder(void *data)
+{
+  struct finderdata *test;
+  size_t i;
+
+  test = (struct finderdata *)data;
+  free(test->bytes);
+  for (i = 0; i < test->count; i++)
+    free(test->needles[i]);
+  free(test->needles);
+  free(test->npos);
+  free(test->nsizes);
+  free(test->hits);
+}
+
+static void
+testbitfinder(void *data)
+{
+  struct finderdata *test;
+  bitfinder *f;
+  bitfinditer it;
+  size_t *hits, nhits, id, offset, end, lastend;
+  bool ordered;
+
+  test = (struct finderdata *)data;
+  f = bitfindermake((const void *const *)test->needles,
+      test->npos, test->nsizes, test->count);
+  testassert(f != NULL, "make failed");
+
+  hits = (size_t *)malloc(sizeof(size_t) * 2 * (test->nhits + 1));
+  nhits = 0;
+  lastend = 0;
+  ordered = true;
+  it = bitfindbegin(f, test->bytes, test->pos, test->size);
+  while (nhits <= test->nhits && bitfindnext(&it, &id, &offset)) {
+    if (nhits < test->nhits) {
+      hits[nhits * 2] = offset;
+      hits[nhits * 2 + 1] = id;
+    }
+    end = id < test->count ? offset + test->nsizes[id] : 0;
+    if (end < lastend)
+      ordered = false;
+    lastend = end;
+    nhits++;
+  }
+  bitfinderfree(f);
+
+  testassert(ordered, "not in order of ends");
+  testassert(nhits == test->nhits, "wrong number of hits");
+  if (nhits == test->nhits) {
+    qsort(hits, nhits, sizeof(size_t) * 2, cmphit);
+    testassert(nhits == 0 ||
+        memcmp(hits, test->hits, sizeof(size_t) * 2 * nhits) == 0,
+        "wrong hits");
+  }
+  free(hits);
+}
+
+void
+inittestbitfind()
+{
+  TESTADD(testbitfind);
+  TESTADD(testbitfindapprox);
+  TESTADD(testbitfinder);
+}
@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.hpp"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  unsigned char c;
+  short s;
+  unsigned int u;
+  long long q;
+  double d;
+  uint64_t bits;
+  size_t nbits;
+  bool flag;
+};
+
+static void **
+datatestbitformat()
+{
+  struct testdata **data;
+  static size_t n = 10000;
+  size_t i;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    data[i]->c = (unsigned char)random();
+    data[i]->s = (short)random();
+    data[i]->u = (unsigned int)random() << 1 ^ (unsigned int)random();
+    data[i]->q = (long long)((uint64_t)random() << 33 ^
+        (uint64_t)random() << 11 ^ (uint64_t)random());
+    data[i]->d = (double)random() / 1024;
+    data[i]->bits = (uint64_t)random() << 33 ^ (uint64_t)random();
+    data[i]->flag = (bool)(abs(random() % 2));
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitformat(void *data)
+{
+  /* do nothing */
+}
+
+#define FORMAT1 \
+  "%C:4 %s< 16#beef%S %I>@40:23 %q:61 'x'%C %d< %Q<@200:48 -3%i:5 |ab|%A"
+#define FORMAT2 "%C@3 %#:7 %s>:13 %I<:32 %A:20 %f %q<@133:64"
+
+static void
+testbitformat(void *data)
+{
+  struct testdata *test;
+  uint8_t buf1[48], buf2[48];
+  unsigned char c;
+  short s;
+  unsigned int u;
+  long long q;
+  unsigned long long w;
+  double d;
+  float f;
+  char str[4], str2[4];
+  size_t n1, n2;
+
+  constexpr auto fmt1 = BITFORMAT(FORMAT1);
+  constexpr auto fmt2 = BITFORMAT(FORMAT2);
+
+  test = (struct testdata *)data;
+  memset(buf1, test->flag ? 0xff : 0, sizeof(buf1));
+  memset(buf2, test->flag ? 0xff : 0, sizeof(buf2));
+
+  /* the same bits as the runtime formats */
+  n1 = fmt1.print(buf1, test->c, test->s, test->u, test->q, test->d,
+      (unsigned long long)test->bits);
+  n2 = bitsprintf(buf2, 0, FORMAT1, test->c, test->s, test->u, test->q,
+      test->d, (unsigned long long)test->bits);
+  if (n1 != n2 || memcmp(buf1, buf2, sizeof(buf1)) != 0) {
+    testassert(false, "bits differ from bitsprintf");
+    return;
+  }
+
+  if (fmt1.scan(buf1, &c, &s, &u, &q, &d, &w) != 6 ||
+      c != (test->c & 0xf) || s != test->s ||
+      u != (test->u & 0x7fffff) ||
+      q != (long long)((uint64_t)test->q << 3) >> 3 || d != test->d ||
+      w != (test->bits & 0xffffffffffffULL)) {
+    testassert(false, "wrong scanned values");
+    return;
+  }
+
+  /* a wrong literal stops the scan */
+  buf1[3] ^= 0x10;
+  if (fmt1.scan(buf1, &c, &s, &u, &q, &d, &w) != 2) {
+    testassert(false, "wrong literal matches");
+    return;
+  }
+
+  memset(str, 0, sizeof(str));
+  memcpy(str, "xyz", 3);
+  n1 = fmt2.print(buf1, test->c, test->s, test->u, str, test->d, test->q);
+  n2 = bitsprintf(buf2, 0, FORMAT2, test->c, test->s, test->u, str,
+      test->d, test->q);
+  if (n1 != n2 || memcmp(buf1, buf2, sizeof(buf1)) != 0) {
+    testassert(false, "bits differ from bitsprintf");
+    return;
+  }
+
+  memset(str2, 0, sizeof(str2));
+  if (fmt2.scan(buf1, &c, &s, &u, str2, &f, &q) != 6 ||
+      c != test->c || s != (short)((short)((uint16_t)test->s << 3) >> 3) ||
+      u != test->u || memcmp(str2, "xy", 2) != 0 ||
+      (str2[2] & 0xf0) != ('z' & 0xf0) || f != (float)test->d ||
+      q != test->q) {
+    testassert(false, "wrong scanned values");
+    return;
+  }
+
+  testassert(true, NULL);
+}
+
+extern "C" void
+inittestbitformat()
+{
+  TESTADD(testbitformat);
+}
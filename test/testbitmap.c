@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  uint8_t *bytes1;
+  uint8_t *bytes2;
+  size_t pos1;
+  size_t pos2;
+  size_t size1;
+  size_t size2;
+};
+
+/* regions of clear, sparse, random, run and set bits */
+static void
+regionrand(uint8_t *bytes, size_t pos, size_t size)
+{
+  size_t i, j, n, k;
+
+  for (i = 0; i < size; i += n) {
+    n = 1 + (size_t)rand() % 150000;
+    if (n > size - i)
+      n = size - i;
+    switch (rand() % 5) {
+    case 0:
+      bitclear(bytes, pos + i, n);
+      break;
+    case 1:
+      bitclear(bytes, pos + i, n);
+      for (j = n / 300 + 1; j > 0; j--)
+        bitset(bytes, pos + i + (size_t)rand() % n, true);
+      break;
+    case 2:
+      bitstdrand(bytes, pos + i, n);
+      break;
+    case 3:
+      bitclear(bytes, pos + i, n);
+      for (j = 0; j < n; j += k + (size_t)rand() % 2000) {
+        k = 1 + (size_t)rand() % 1000;
+        if (k > n - j)
+          k = n - j;
+        bitfill(bytes, pos + i + j, k, 1, 1);
+      }
+      break;
+    default:
+      bitfill(bytes, pos + i, n, 1, 1);
+      break;
+    }
+  }
+}
+
+static void **
+datatestbitmap()
+{
+  struct testdata **data;
+  static size_t n = 100, maxcapa = 50000;
+  size_t i, capa, size;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    capa = gencapa(maxcapa);
+    data[i]->bytes1 = (uint8_t *)malloc(capa);
+    data[i]->bytes2 = (uint8_t *)malloc(capa);
+    data[i]->size1 = gensize(capa);
+    data[i]->size2 = genbool() ? data[i]->size1 : gensize(capa);
+    data[i]->pos1 = genpos(capa, data[i]->size1);
+    data[i]->pos2 = genpos(capa, data[i]->size2);
+    bitstdrand(data[i]->bytes1, 0, capa * 8);
+    bitstdrand(data[i]->bytes2, 0, capa * 8);
+    regionrand(data[i]->bytes1, data[i]->pos1, data[i]->size1);
+    if (rand() % 3 == 0) {
+      /* mostly the same bits */
+      size = data[i]->size1 < data[i]->size2 ?
+        data[i]->size1 : data[i]->size2;
+      bitcpy(data[i]->bytes2, data[i]->pos2,
+          data[i]->bytes1, data[i]->pos1, size);
+      bitset(data[i]->bytes2, data[i]->pos2, genbool());
+    } else {
+      regionrand(data[i]->bytes2, data[i]->pos2, data[i]->size2);
+    }
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitmap(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  free(test->bytes1);
+  free(test->bytes2);
+}
+
+static void
+testbitmap(void *data)
+{
+  struct testdata *test;
+  bitmap *m;
+  uint8_t *bytes;
+  size_t i, pos;
+  bool same = true;
+
+  test = (struct testdata *)data;
+  m = bitmapmake(test->bytes1, test->pos1, test->size1);
+  testassert(bitmapsize(m) == test->size1, "wrong size");
+  testassert(bitmapcount(m) == bitcount(test->bytes1, test->pos1,
+        test->size1), "wrong count");
+
+  pos = (size_t)rand() % 8;
+  bytes = (uint8_t *)malloc(test->size1 / 8 + 2);
+  bitmapcopy(bytes, pos, m);
+  testassert(biteq(bytes, pos, test->bytes1, test->pos1, test->size1),
+      "wrong bits");
+  for (i = 0; i < test->size1; i += 1 + (size_t)rand() % 100) {
+    if (bitmapget(m, i) != bitget(test->bytes1, test->pos1 + i))
+      same = false;
+  }
+  testassert(same && !bitmapget(m, test->size1), "wrong bit");
+  testassert(bitmapbytes(m) <= (test->size1 / 65536 + 1) * (8192 + 64),
+      "not compressed");
+  free(bytes);
+  bitmapfree(m);
+}
+
+static void
+testbitmapop(void *data)
+{
+  struct testdata *test;
+  bitmap *m1, *m2, *m;
+  uint8_t *bytes1, *bytes2, *expected, *bytes;
+  size_t size, count;
+  int op;
+
+  test = (struct testdata *)data;
+  m1 = bitmapmake(test->bytes1, test->pos1, test->size1);
+  m2 = bitmapmake(test->bytes2, test->pos2, test->size2);
+
+  /* the operands are clear beyond their sizes */
+  size = test->size1 > test->size2 ? test->size1 : test->size2;
+  bytes1 = (uint8_t *)calloc(size / 8 + 1, 1);
+  bytes2 = (uint8_t *)calloc(size / 8 + 1, 1);
+  expected = (uint8_t *)malloc(size / 8 + 1);
+  bytes = (uint8_t *)malloc(size / 8 + 1);
+  bitcpy(bytes1, 0, test->bytes1, test->pos1, test->size1);
+  bitcpy(bytes2, 0, test->bytes2, test->pos2, test->size2);
+
+  for (op = 0; op < 4; op++) {
+    switch (op) {
+    case 0:
+      bitand(expected, 0, bytes1, 0, bytes2, 0, size);
+      m = bitmapand(m1, m2);
+      count = bitmapandcount(m1, m2);
+      break;
+    case 1:
+      bitor(expected, 0, bytes1, 0, bytes2, 0, size);
+      m = bitmapor(m1, m2);
+      count = bitmaporcount(m1, m2);
+      break;
+    case 2:
+      bitxor(expected, 0, bytes1, 0, bytes2, 0, size);
+      m = bitmapxor(m1, m2);
+      count = bitmapxorcount(m1, m2);
+      break;
+    default:
+      bitnot(expected, 0, bytes2, 0, size);
+      bitand(expected, 0, bytes1, 0, expected, 0, size);
+      m = bitmapandnot(m1, m2);
+      count = bitmapandnotcount(m1, m2);
+      break;
+    }
+    bitmapcopy(bytes, 0, m);
+    testassert(bitmapsize(m) == size, "wrong size");
+    testassert(biteq(bytes, 0, expected, 0, size), "wrong bits");
+    testassert(bitmapcount(m) == bitcount(expected, 0, size) &&
+        count == bitmapcount(m), "wrong count");
+    bitmapfree(m);
+  }
+
+  free(bytes1);
+  free(bytes2);
+  free(expected);
+  free(bytes);
+  bitmapfree(m1);
+  bitmapfree(m2);
+}
+
+void
+inittestbitmap()
+{
+  TESTADD(testbitmap);
+  testadd("testbitmapop", datatestbitmap, testbitmapop, freetestbitmap);
+}
@@ -0,0 +1,164 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  uint8_t *bytes;
+  size_t pos;
+  size_t size;
+  char *text;
+  char *bitchars;       /* the pattern without separators */
+  size_t psize;
+  size_t nhits;
+  size_t *hits;
+};
+
+static bool
+matchat(const struct testdata *test, size_t offset)
+{
+  size_t i;
+  char c;
+
+  for (i = 0; i < test->psize; i++) {
+    c = test->bitchars[i];
+    if ((c == '0' || c == '1') &&
+        bitget(test->bytes, test->pos + offset + i) != (c == '1'))
+      return false;
+  }
+  return true;
+}
+
+static void **
+datatestbitmatch()
+{
+  struct testdata **data;
+  static size_t n = 3000, maxcapa = 256, maxpattern = 150;
+  static const char wild[] = "??xX";
+  size_t i, j, k, t, capa, wilds;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    capa = gencapa(maxcapa);
+    data[i]->bytes = (uint8_t *)calloc(capa, 1);
+    data[i]->size = gensize(capa);
+    data[i]->pos = genpos(capa, data[i]->size);
+    bitstdrand(data[i]->bytes, data[i]->pos, data[i]->size);
+
+    if (rand() % 4 == 0)
+      data[i]->psize = 1 + (size_t)rand() % maxpattern;
+    else
+      data[i]->psize = 1 + (size_t)rand() % 24;
+    data[i]->bitchars = (char *)malloc(data[i]->psize + 1);
+    data[i]->text = (char *)malloc(data[i]->psize * 2 + 1);
+    wilds = (size_t)rand() % 4;
+    k = data[i]->psize <= data[i]->size ?
+      (size_t)rand() % (data[i]->size - data[i]->psize + 1) : 0;
+    for (j = t = 0; j < data[i]->psize; j++) {
+      if ((size_t)rand() % 4 < wilds)
+        data[i]->bitchars[j] = wild[rand() % 4];
+      else if (data[i]->psize <= data[i]->size && k % 2 == 0)
+        /* taken from the haystack */
+        data[i]->bitchars[j] =
+          bitget(data[i]->bytes, data[i]->pos + k + j) ? '1' : '0';
+      else
+        data[i]->bitchars[j] = genbool() ? '1' : '0';
+      data[i]->text[t++] = data[i]->bitchars[j];
+      if (rand() % 8 == 0)
+        data[i]->text[t++] = genbool() ? ' ' : '_';
+    }
+    data[i]->bitchars[j] = '\0';
+    data[i]->text[t] = '\0';
+
+    data[i]->nhits = 0;
+    data[i]->hits = (size_t *)malloc(sizeof(size_t) * (data[i]->size + 1));
+    for (k = 0; k + data[i]->psize <= data[i]->size; k++) {
+      if (matchat(data[i], k))
+        data[i]->hits[data[i]->nhits++] = k;
+    }
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitmatch(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  free(test->bytes);
+  free(test->text);
+  free(test->bitchars);
+  free(test->hits);
+}
+
+static void
+testbitmatch(void *data)
+{
+  struct testdata *test;
+  bitpattern *p;
+  size_t k;
+  bool same;
+
+  test = (struct testdata *)data;
+  p = bitpatternmake(test->text);
+  testassert(p != NULL && bitpatternsize(p) == test->psize,
+      "make failed");
+  same = true;
+  for (k = 0; k + test->psize <= test->size; k++) {
+    if (bitmatch(test->bytes, test->pos + k, p) != matchat(test, k))
+      same = false;
+  }
+  testassert(same, "test failed");
+  testassert(bitpatternmake("01?2") == NULL, "invalid pattern made");
+  bitpatternfree(p);
+
+  /* empty patterns match anywhere */
+  p = bitpatternmake("");
+  testassert(p != NULL && bitpatternsize(p) == 0 &&
+      bitmatch(test->bytes, test->pos, p) &&
+      bitmatchscan(test->bytes, test->pos, test->size, p) == 0,
+      "empty pattern failed");
+  bitpatternfree(p);
+  p = bitpatternmake(" _ ");
+  testassert(p != NULL && bitpatternsize(p) == 0, "empty pattern failed");
+  bitpatternfree(p);
+}
+
+static void
+testbitmatchscan(void *data)
+{
+  struct testdata *test;
+  bitpattern *p;
+  size_t nhits, offset, r;
+  bool same;
+
+  test = (struct testdata *)data;
+  p = bitpatternmake(test->text);
+  nhits = 0;
+  same = true;
+  for (offset = 0; offset <= test->size; offset += r + 1) {
+    r = bitmatchscan(test->bytes, test->pos + offset, test->size - offset, p);
+    if (r == test->size - offset)
+      break;
+    if (nhits >= test->nhits || test->hits[nhits] != offset + r)
+      same = false;
+    nhits++;
+  }
+  testassert(same && nhits == test->nhits, "test failed");
+  bitpatternfree(p);
+}
+
+void
+inittestbitmatch()
+{
+  TESTADD(testbitmatch);
+  testadd("testbitmatchscan", datatestbitmatch, testbitmatchscan,
+      freetestbitmatch);
+}
@@ -0,0 +1,153 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  uint8_t *bytes;
+  size_t pos;
+  size_t size;
+  size_t nsets;
+  size_t *sets;         /* the offsets of the set bits */
+};
+
+static void **
+datatestbitnext()
+{
+  struct testdata **data;
+  static size_t n = 3000, maxcapa = 1024;
+  static const int densities[] = { 0, 1, 8, 512, 1016, 1024 };
+  size_t i, j, capa;
+  int density;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    capa = gencapa(maxcapa);
+    data[i]->bytes = (uint8_t *)malloc(capa);
+    data[i]->size = gensize(capa);
+    data[i]->pos = genpos(capa, data[i]->size);
+    bitstdrand(data[i]->bytes, 0, capa * 8);
+    density = densities[rand() % 6];
+    for (j = 0; j < data[i]->size; j++)
+      bitset(data[i]->bytes, data[i]->pos + j, rand() % 1024 < density);
+
+    data[i]->nsets = 0;
+    data[i]->sets = (size_t *)malloc(sizeof(size_t) * (data[i]->size + 1));
+    for (j = 0; j < data[i]->size; j++) {
+      if (bitget(data[i]->bytes, data[i]->pos + j))
+        data[i]->sets[data[i]->nsets++] = j;
+    }
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitnext(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  free(test->bytes);
+  free(test->sets);
+}
+
+static void
+testbitnextset(void *data)
+{
+  struct testdata *test;
+  size_t i, k, expected;
+  bool same = true;
+
+  test = (struct testdata *)data;
+  for (i = k = 0; i <= test->size; i++) {
+    while (k < test->nsets && test->sets[k] < i)
+      k++;
+    expected = k < test->nsets ? test->sets[k] - i : test->size - i;
+    if (bitnextset(test->bytes, test->pos + i, test->size - i) != expected)
+      same = false;
+  }
+  testassert(same, "test failed");
+}
+
+static void
+testbitnextclear(void *data)
+{
+  struct testdata *test;
+  size_t i, j, expected;
+  bool same = true;
+
+  test = (struct testdata *)data;
+  for (i = 0; i <= test->size; i += 1 + (size_t)rand() % 16) {
+    for (j = i; j < test->size && bitget(test->bytes, test->pos + j); j++)
+      ;
+    expected = j - i;
+    if (bitnextclear(test->bytes, test->pos + i, test->size - i) != expected)
+      same = false;
+  }
+  testassert(same, "test failed");
+}
+
+static void
+testbitprevset(void *data)
+{
+  struct testdata *test;
+  size_t i, k, expected;
+  bool same = true;
+
+  test = (struct testdata *)data;
+  for (i = k = 0; i <= test->size; i++) {
+    /* the last set bit before i */
+    while (k < test->nsets && test->sets[k] < i)
+      k++;
+    expected = k > 0 ? test->sets[k - 1] : i;
+    if (bitprevset(test->bytes, test->pos, i) != expected)
+      same = false;
+  }
+  testassert(same, "test failed");
+}
+
+static void
+testbitnextsetn(void *data)
+{
+  struct testdata *test;
+  size_t *offsets, n, j, k, from, got;
+  bool same = true;
+
+  test = (struct testdata *)data;
+  n = 1 + (size_t)rand() % 100;
+  offsets = (size_t *)malloc(sizeof(size_t) * n);
+  from = 0;
+  k = 0;
+  while (from <= test->size) {
+    got = bitnextsetn(test->bytes, test->pos + from, test->size - from,
+        offsets, n);
+    if (got == 0)
+      break;
+    for (j = 0; j < got && same; j++, k++)
+      same = k < test->nsets && test->sets[k] == from + offsets[j];
+    if (!same)
+      break;
+    from += offsets[got - 1] + 1;
+  }
+  testassert(same && k == test->nsets, "test failed");
+  free(offsets);
+}
+
+void
+inittestbitnext()
+{
+  testadd("testbitnextset", datatestbitnext, testbitnextset,
+      freetestbitnext);
+  testadd("testbitnextclear", datatestbitnext, testbitnextclear,
+      freetestbitnext);
+  testadd("testbitprevset", datatestbitnext, testbitprevset,
+      freetestbitnext);
+  testadd("testbitnextsetn", datatestbitnext, testbitnextsetn,
+      freetestbitnext);
+}
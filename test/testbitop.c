@@ -84,7 +84,9 @@ static void
 testbitop(int op, void *data)
 {
   struct testdata *test;
-  uint8_t *buf;
+  uint8_t *buf, *expected;
+  size_t i;
+  bool f1, f2;
   void (*tester)(void *dest, size_t destpos,
       const void *bits1, size_t pos1,
       const void *bits2, size_t pos2, size_t size) = NULL;
@@ -113,6 +115,25 @@ testbitop(int op, void *data)
   testassert(biteq(buf, 0, test->expected, 0, test->capa * 8),
       "failed to write bits to a same buffer");
 
+  /* all operands in a same buffer */
+  expected = (uint8_t *)malloc(test->capa);
+  memcpy(expected, test->bytes1, test->capa);
+  for (i = 0; i < test->size; i++) {
+    f1 = bitget(test->bytes1, test->pos1 + i);
+    f2 = bitget(test->bytes1, test->pos2 + i);
+    if (op == ANDOP)
+      bitset(expected, test->expos + i, f1 & f2);
+    else if (op == OROP)
+      bitset(expected, test->expos + i, f1 | f2);
+    else
+      bitset(expected, test->expos + i, f1 ^ f2);
+  }
+  memcpy(buf, test->bytes1, test->capa);
+  tester(buf, test->expos, buf, test->pos1, buf, test->pos2, test->size);
+  testassert(biteq(buf, 0, expected, 0, test->capa * 8),
+      "failed to write bits to a buffer of all operands");
+
+  free(expected);
   free(buf);
 }
 
@@ -280,6 +301,146 @@ testbitreverse(void *data)
   testassert(biteq(buf, 0, test->expected, 0, test->capa * 8),
       "failed to write reversed bits to the pointer");
 
+  /* in place */
+  memcpy(buf, test->bytes1, test->capa);
+  bitreverse(buf, test->pos1, buf, test->pos1, test->size);
+  testassert(biteq(buf, test->pos1, test->expected, test->expos, test->size),
+      "failed to reverse bits in place");
+
+  free(buf);
+}
+
+struct opndata {
+  size_t capa;
+  size_t count;
+  uint8_t **bytes;
+  size_t *pos;
+  size_t size;
+  uint8_t *dest;
+  size_t destpos;
+  size_t *counts;       /* the operands with each bit set */
+};
+
+static void **
+datatestbitopn()
+{
+  struct opndata **data;
+  static size_t n = 2000, maxcapa = 2048, maxcount = 40;
+  size_t i, j, k;
+  struct opndata *d;
+
+  data = (struct opndata **)malloc(sizeof(struct opndata *) * (n+1));
+  data[n] = NULL;
+
+  for (i = 0; i < n; i++) {
+    d = data[i] = (struct opndata *)malloc(sizeof(struct opndata));
+    d->capa = gencapa(maxcapa);
+    d->size = gensize(d->capa);
+    d->destpos = genpos(d->capa, d->size);
+    d->count = rand() % 4 == 0 ? (size_t)rand() % maxcount :
+      (size_t)rand() % 5;
+    d->bytes = (uint8_t **)malloc(sizeof(uint8_t *) * (d->count + 1));
+    d->pos = (size_t *)malloc(sizeof(size_t) * (d->count + 1));
+    d->dest = (uint8_t *)malloc(d->capa);
+    d->counts = (size_t *)calloc(d->size + 1, sizeof(size_t));
+    bitstdrand(d->dest, 0, d->capa * 8);
+
+    for (j = 0; j < d->count; j++) {
+      d->bytes[j] = (uint8_t *)malloc(d->capa);
+      d->pos[j] = genpos(d->capa, d->size);
+      bitstdrand(d->bytes[j], 0, d->capa * 8);
+      for (k = 0; k < d->size; k++)
+        d->counts[k] += bitget(d->bytes[j], d->pos[j] + k);
+    }
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitopn(void *data)
+{
+  struct opndata *test;
+  size_t i;
+
+  test = data;
+  for (i = 0; i < test->count; i++)
+    free(test->bytes[i]);
+  free(test->bytes);
+  free(test->pos);
+  free(test->dest);
+  free(test->counts);
+}
+
+/* whether buf has the bits of op from the counts, and dest elsewhere */
+static bool
+checkbitopn(const struct opndata *test, const uint8_t *buf, size_t destpos,
+    int op, size_t t)
+{
+  uint8_t *expected;
+  size_t i, c;
+  bool f, same;
+
+  expected = (uint8_t *)malloc(test->capa);
+  memcpy(expected, test->dest, test->capa);
+  for (i = 0; i < test->size; i++) {
+    c = test->counts[i];
+    if (op == ANDOP)
+      f = c == test->count;
+    else if (op == OROP)
+      f = c > 0;
+    else if (op == XOROP)
+      f = c % 2 == 1;
+    else
+      f = c >= t;
+    bitset(expected, destpos + i, f);
+  }
+  same = biteq(buf, 0, expected, 0, test->capa * 8);
+  free(expected);
+  return same;
+}
+
+static void
+testbitopn(void *data)
+{
+  struct opndata *test;
+  uint8_t *buf;
+  const void **bits;
+  size_t t;
+  int op;
+  void (*tester)(void *dest, size_t destpos, const void *const *bits,
+      const size_t *pos, size_t count, size_t size);
+
+  test = data;
+  buf = (uint8_t *)malloc(test->capa);
+  bits = (const void **)malloc(sizeof(void *) * (test->count + 1));
+  memcpy(bits, test->bytes, sizeof(void *) * test->count);
+
+  for (op = ANDOP; op <= XOROP; op++) {
+    tester = op == ANDOP ? bitandn : op == OROP ? bitorn : bitxorn;
+    memcpy(buf, test->dest, test->capa);
+    tester(buf, test->destpos, bits, test->pos, test->count, test->size);
+    testassert(checkbitopn(test, buf, test->destpos, op, 0),
+        "failed to write bits of the operands");
+  }
+
+  t = (size_t)rand() % (test->count + 2);
+  memcpy(buf, test->dest, test->capa);
+  bitatleast(buf, test->destpos, bits, test->pos, test->count, test->size, t);
+  testassert(checkbitopn(test, buf, test->destpos, -1, t),
+      "failed to write bits set in at least t operands");
+
+  /* in place of the first operand */
+  if (test->count > 0) {
+    memcpy(buf, test->dest, test->capa);
+    bitcpy(buf, test->pos[0], test->bytes[0], test->pos[0], test->size);
+    bits[0] = buf;
+    bitxorn(buf, test->pos[0], bits, test->pos, test->count, test->size);
+    testassert(checkbitopn(test, buf, test->pos[0], XOROP, 0),
+        "failed to write bits in place");
+  }
+
+  free(bits);
   free(buf);
 }
 
@@ -291,5 +452,6 @@ inittestbitop()
   testadd("testbitxor", datatestbitxor, testbitxor, freetestbitop);
   TESTADD(testbitnot);
   TESTADD(testbitreverse);
+  TESTADD(testbitopn);
 }
 
@@ -11,6 +11,7 @@ struct testdata {
   size_t pos;
   size_t size;
   bool flag;
+  uint64_t seed;
 };
 
 static void **
@@ -37,6 +38,7 @@ datatestbitstdrand()
       data[i]->pos =
         (size_t)(abs(rand() % (bytesize * 8 - data[i]->size)));
     data[i]->flag = (bool)(abs(random() % 2));
+    data[i]->seed = (uint64_t)random() << 32 | (uint64_t)random();
   }
 
   return (void **)data;
@@ -91,9 +93,73 @@ testbitstdrand(void *data)
   testassert(true, NULL);
 }
 
+static void
+testbitrandfill(void *data)
+{
+  struct testdata *test;
+  bitrandstate state;
+  uint8_t *buf;
+  size_t i;
+
+  test = data;
+  memset(test->bytes, test->flag ? 0xff : 0, test->capa);
+  bitrandseed(&state, test->seed, 0);
+  bitrandfill(&state, test->bytes, test->pos, test->size);
+  for (i = 0; i < test->pos; i++) {
+    if (bitget(test->bytes, i) != test->flag) {
+      testassert(false, "bits between 0 and pos are modified");
+      return;
+    }
+  }
+  for (i = test->pos + test->size; i < test->capa * 8; i++) {
+    if (bitget(test->bytes, i) != test->flag) {
+      testassert(false, "rest bits are modified");
+      return;
+    }
+  }
+
+  /* same seed and stream */
+  buf = (uint8_t *)malloc(test->capa);
+  memset(buf, 0, test->capa);
+  bitrandseed(&state, test->seed, 0);
+  bitrandfill(&state, buf, test->pos, test->size);
+  testassert(biteq(buf, test->pos, test->bytes, test->pos, test->size),
+      "bits are not reproduced");
+
+  /* another stream */
+  bitrandseed(&state, test->seed, 1);
+  bitrandfill(&state, buf, test->pos, test->size);
+  testassert(test->size <= 64 ||
+      !biteq(buf, test->pos, test->bytes, test->pos, test->size),
+      "streams generate same bits");
+
+  /* a far stream */
+  bitrandseed(&state, test->seed, (uint64_t)1 << 40);
+  bitrandfill(&state, buf, test->pos, test->size);
+  testassert(test->size <= 64 ||
+      !biteq(buf, test->pos, test->bytes, test->pos, test->size),
+      "far stream generates same bits");
+
+  /* a stream equal to the seed, and the seed and stream swapped */
+  bitrandseed(&state, test->seed, test->seed);
+  bitrandfill(&state, buf, test->pos, test->size);
+  testassert(test->size <= 64 ||
+      bitcount(buf, test->pos, test->size) > 0, "stream cancels the seed");
+  bitrandseed(&state, test->seed, test->seed + 1);
+  bitrandfill(&state, test->bytes, test->pos, test->size);
+  bitrandseed(&state, test->seed + 1, test->seed);
+  bitrandfill(&state, buf, test->pos, test->size);
+  testassert(test->size <= 64 ||
+      !biteq(buf, test->pos, test->bytes, test->pos, test->size),
+      "swapped seed and stream generate same bits");
+  free(buf);
+}
+
 void
 inittestbitrand()
 {
   TESTADD(testbitstdrand);
+  testadd("testbitrandfill", datatestbitstdrand, testbitrandfill,
+      freetestbitstdrand);
 }
 
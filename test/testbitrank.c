@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  uint8_t *bytes;
+  size_t pos;
+  size_t size;
+  int density;          /* set bits per 1024 */
+  size_t *ranks;        /* the set bits before each bit */
+};
+
+static void
+setdensity(uint8_t *bytes, size_t pos, size_t size, int density)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    bitset(bytes, pos + i, rand() % 1024 < density);
+}
+
+static void
+countranks(struct testdata *test)
+{
+  size_t i;
+
+  test->ranks[0] = 0;
+  for (i = 0; i < test->size; i++) {
+    test->ranks[i + 1] = test->ranks[i] +
+      bitget(test->bytes, test->pos + i);
+  }
+}
+
+static void **
+datatestbitrank()
+{
+  struct testdata **data;
+  static size_t n = 200, maxcapa = 12000;
+  static const int densities[] = { 1, 30, 512, 1000, 1024 };
+  size_t i, capa;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    capa = gencapa(maxcapa);
+    data[i]->bytes = (uint8_t *)malloc(capa);
+    data[i]->size = gensize(capa);
+    data[i]->pos = genpos(capa, data[i]->size);
+    data[i]->density = densities[rand() % 5];
+    bitstdrand(data[i]->bytes, 0, capa * 8);
+    setdensity(data[i]->bytes, data[i]->pos, data[i]->size,
+        data[i]->density);
+    data[i]->ranks = (size_t *)malloc(sizeof(size_t) * (data[i]->size + 1));
+    countranks(data[i]);
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitrank(void *data)
+{
+  struct testdata *test;
+
+  test = (struct testdata *)data;
+  free(test->bytes);
+  free(test->ranks);
+}
+
+/* whether the index agrees with the counted ranks */
+static bool
+checkrank(const bitrank *r, const struct testdata *test)
+{
+  size_t i;
+
+  for (i = 0; i <= test->size; i++) {
+    if (bitrank1(r, i) != test->ranks[i])
+      return false;
+  }
+  for (i = 0; i < test->size; i++) {
+    if (test->ranks[i + 1] != test->ranks[i] &&
+        bitselect1(r, test->ranks[i]) != i)
+      return false;
+  }
+  return bitselect1(r, test->ranks[test->size]) == test->size;
+}
+
+static void
+testbitrank(void *data)
+{
+  struct testdata *test;
+  bitrank *r;
+
+  test = (struct testdata *)data;
+  r = bitrankmake(test->bytes, test->pos, test->size);
+  testassert(checkrank(r, test), "test failed");
+  bitrankfree(r);
+}
+
+static void
+testbitrankupdate(void *data)
+{
+  struct testdata *test;
+  bitrank *r;
+  size_t i, from, n;
+  bool same;
+
+  test = (struct testdata *)data;
+  r = bitrankmake(test->bytes, test->pos, test->size);
+  same = true;
+  for (i = 0; i < 4 && test->size > 0; i++) {
+    from = (size_t)rand() % test->size;
+    n = 1 + (size_t)rand() % (test->size - from);
+    if (genbool() && n > 300)
+      n = 300;
+    if (i == 0 && test->size > 8292) {
+      /* across the base at 8192 bits of the test build */
+      from = 8092;
+      n = 200;
+    }
+    setdensity(test->bytes, test->pos + from, n, rand() % 1025);
+    bitrankupdate(r, from, n);
+    countranks(test);
+    same = same && checkrank(r, test);
+  }
+  testassert(same, "test failed");
+  bitrankfree(r);
+}
+
+void
+inittestbitrank()
+{
+  TESTADD(testbitrank);
+  testadd("testbitrankupdate", datatestbitrank, testbitrankupdate,
+      freetestbitrank);
+}
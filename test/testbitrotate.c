@@ -20,7 +20,7 @@ static void **
 datatestbitlrotate()
 {
   struct testdata **data;
-  static size_t n = 10000, maxcapa = 2;
+  static size_t n = 10000, maxcapa = 1024;
   size_t i, j;
   bool f;
 
@@ -91,6 +91,12 @@ testbitlrotate(void *data)
   testassert(biteq(buf, 0, test->expected, 0, test->capa * 8),
       "failed to write bits to a same buffer");
 
+  /* in place */
+  memcpy(buf, test->bytes, test->capa);
+  bitlrotate(buf, test->pos, buf, test->pos, test->size, test->shift);
+  testassert(biteq(buf, test->pos, test->expected, test->expos, test->size),
+      "failed to rotate bits in place");
+
   free(buf);
 }
 
@@ -98,7 +104,7 @@ static void **
 datatestbitrrotate()
 {
   struct testdata **data;
-  static size_t n = 10000, maxcapa = 2;
+  static size_t n = 10000, maxcapa = 1024;
   size_t i, j;
   bool f;
 
@@ -171,6 +177,12 @@ testbitrrotate(void *data)
   testassert(biteq(buf, 0, test->expected, 0, test->capa * 8),
       "failed to write bits to a same buffer");
 
+  /* in place */
+  memcpy(buf, test->bytes, test->capa);
+  bitrrotate(buf, test->pos, buf, test->pos, test->size, test->shift);
+  testassert(biteq(buf, test->pos, test->expected, test->expos, test->size),
+      "failed to rotate bits in place");
+
   free(buf);
 }
 
@@ -0,0 +1,596 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+struct testdata {
+  size_t capa;
+  size_t pos;
+  size_t size;
+  uint64_t value;
+  bool little;
+  bool flag;
+};
+
+static void **
+datatestbitsprintf()
+{
+  struct testdata **data;
+  static size_t n = 10000, maxcapa = 32;
+  size_t i;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    data[i]->capa = gencapa(maxcapa) + 8;
+    data[i]->size = (size_t)(abs(rand()) % 64) + 1;
+    data[i]->pos = genpos(data[i]->capa, data[i]->size);
+    data[i]->value = (uint64_t)random() << 33 ^ (uint64_t)random() << 11 ^
+      (uint64_t)random();
+    data[i]->little = (bool)(abs(random() % 2));
+    data[i]->flag = (bool)(abs(random() % 2));
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitsprintf(void *data)
+{
+  /* do nothing */
+}
+
+static void
+testbitsprintf(void *data)
+{
+  struct testdata *test;
+  uint8_t *buf;
+  uint64_t v, w;
+  size_t i, k, n, pos, size;
+  long long sv;
+  bool f;
+
+  test = data;
+  buf = (uint8_t *)malloc(test->capa);
+  memset(buf, test->flag ? 0xff : 0, test->capa);
+  v = test->size < 64 ? test->value & (((uint64_t)1 << test->size) - 1) :
+    test->value;
+
+  n = bitsprintf(buf, 0, test->little ? "%Q<@?:?" : "%Q>@?:?",
+      test->pos, test->size, (unsigned long long)test->value);
+  if (n != test->pos + test->size) {
+    testassert(false, "wrong end of bits");
+    goto error;
+  }
+
+  /* little endian swaps whole bytes only */
+  w = v;
+  if (test->little && test->size % 8 == 0 && test->size > 8) {
+    for (w = 0, i = 0; i < test->size; i += 8)
+      w = w << 8 | (v >> i & 0xff);
+  }
+
+  for (i = 0; i < test->pos; i++) {
+    if (bitget(buf, i) != test->flag) {
+      testassert(false, "bits between 0 and pos are modified");
+      goto error;
+    }
+  }
+
+  for (i = 0; i < test->size; i++) {
+    k = test->size - i - 1;
+    f = (bool)((w >> k) & 1);
+    if (bitget(buf, test->pos + i) != f) {
+      testassert(false, "wrong bits");
+      goto error;
+    }
+  }
+
+  for (i = test->pos + test->size; i < test->capa * 8; i++) {
+    if (bitget(buf, i) != test->flag) {
+      testassert(false, "rest bits are modified");
+      goto error;
+    }
+  }
+
+  w = 0;
+  n = bitsscanf(buf, test->pos, test->little ? "%Q<:? %#@^:^" : "%Q>:? %#@^:^",
+      test->size, &w, &pos, &size);
+  if (n != 1 || w != v || pos != test->size || size != 0) {
+    testassert(false, "wrong scanned value");
+    goto error;
+  }
+
+  /* signed values are sign-extended */
+  n = bitsscanf(buf, test->pos, test->little ? "%q<:?" : "%q>:?",
+      test->size, &sv);
+  w = v;
+  if (test->size < 64 && (v >> (test->size - 1) & 1))
+    w |= ~(((uint64_t)1 << test->size) - 1);
+  if (n != 1 || (uint64_t)sv != w) {
+    testassert(false, "wrong sign extension");
+    goto error;
+  }
+
+  free(buf);
+  testassert(true, NULL);
+  return;
+
+error:
+  free(buf);
+}
+
+static void **
+datatestbitsscanf()
+{
+  void **data;
+
+  /* formats are checked once */
+  data = (void **)malloc(sizeof(void *) * 2);
+  data[0] = malloc(1);
+  data[1] = NULL;
+  return data;
+}
+
+static void
+freetestbitsscanf(void *data)
+{
+  /* do nothing */
+}
+
+static void
+testbitsscanf(void *data)
+{
+  uint8_t buf[64];
+  unsigned char c1, c2;
+  unsigned short s;
+  int i;
+  double d;
+  float f;
+  char str[16];
+  size_t pos, size;
+  char *code;
+
+  memset(buf, 0, sizeof(buf));
+  if (bitsprintf(buf, 0, "%C:4%C:4", 0xa, 0x5) != 8 || buf[0] != 0xa5) {
+    testassert(false, "wrong packed bits");
+    return;
+  }
+
+  if (bitsprintf(buf, 4, "%S<%S>", 0x1234, 0x1234) != 32 ||
+      buf[0] != 0xa3 || buf[1] != 0x41 || buf[2] != 0x21 || buf[3] != 0x23 ||
+      buf[4] >> 4 != 0x4) {
+    testassert(false, "wrong byte order");
+    return;
+  }
+
+  if (bitsscanf(buf, 0, "%C:4%S<%S>", &c1, &s, &s) != 3 || c1 != 0xa ||
+      s != 0x1234) {
+    testassert(false, "wrong byte order scanned");
+    return;
+  }
+
+  /* literals are written without arguments and must match */
+  memset(buf, 0, sizeof(buf));
+  if (bitsprintf(buf, 0, "16#beef%S 'x'%C 2#101%C:3 -3%i:5 \"ab\"%A %i",
+        -1) != 16 + 8 + 3 + 5 + 16 + 32) {
+    testassert(false, "wrong end of literals");
+    return;
+  }
+  if (bitsscanf(buf, 0, "16#BEEF%S 120%C 5%C:3 -3%i:5 |ab|%A %i", &i) != 1 ||
+      i != -1) {
+    testassert(false, "literals do not match");
+    return;
+  }
+  if (bitsscanf(buf, 0, "16#beef%S 'y'%C %C", &c1) != 0) {
+    testassert(false, "wrong literal matches");
+    return;
+  }
+
+  /* positions and strings */
+  memset(buf, 0, sizeof(buf));
+  bitsprintf(buf, 3, "%a %d %f@200 %C@?", "bits", 1.5, 2.25f, (size_t)300,
+      0x81);
+  if (bitsscanf(buf, 3, "%a@^ %d %f@200 %C@300 %C@?:^", &pos, str, &d, &f,
+        &c1, (size_t)301, &size, &c2) != 5 || strcmp(str, "bits") != 0 ||
+      pos != 0 || d != 1.5 || f != 2.25f || c1 != 0x81 || c2 != 0x02 ||
+      size != 8) {
+    testassert(false, "wrong positions and strings");
+    return;
+  }
+
+  if (bitcompilef("%z", NULL) != NULL || bitcompilef("%C:", NULL) != NULL ||
+      bitcompilef("37#1%C", NULL) != NULL || bitcompilef("\"a%A", NULL) != NULL) {
+    testassert(false, "wrong format is compiled");
+    return;
+  }
+
+  /* compiled code runs many times */
+  code = bitcompilef("%C:4 %C:4", &size);
+  if (code == NULL || size == 0) {
+    testassert(false, "format is not compiled");
+    return;
+  }
+  bitsprintc(buf, 1, code, 0x3, 0xc);
+  if (bitsscanc(buf, 1, code, &c1, &c2) != 2 || c1 != 0x3 || c2 != 0xc) {
+    free(code);
+    testassert(false, "wrong compiled code");
+    return;
+  }
+  free(code);
+
+  testassert(true, NULL);
+}
+
+static void **
+datatestbitcache()
+{
+  void **data;
+
+  data = (void **)malloc(sizeof(void *) * 2);
+  data[0] = malloc(1);
+  data[1] = NULL;
+  return data;
+}
+
+static void
+freetestbitcache(void *data)
+{
+  /* do nothing */
+}
+
+static const char *cacheformats[] = {
+  "%C:4 %C:4", "%S<@3 %C", "%I>:20 %C:4", "%q:33 %C"
+};
+
+static void *
+cachethread(void *data)
+{
+  uint8_t buf[16];
+  unsigned long long v1, v2;
+  unsigned char c;
+  size_t i, k;
+  long fails = 0;
+
+  for (i = 0; i < 20000; i++) {
+    k = i % 4;
+    v1 = i & 0xf;
+    c = 0;
+    bitsprintf(buf, 0, cacheformats[k], (int)v1, (int)(i & 0xf));
+    v2 = 0;
+    if (k == 0) {
+      unsigned char u;
+      bitsscanf(buf, 0, cacheformats[k], &u, &c);
+      v2 = u;
+    } else if (k == 1) {
+      unsigned short u;
+      bitsscanf(buf, 0, cacheformats[k], &u, &c);
+      v2 = u;
+    } else if (k == 2) {
+      unsigned int u;
+      bitsscanf(buf, 0, cacheformats[k], &u, &c);
+      v2 = u;
+    } else {
+      long long q;
+      bitsscanf(buf, 0, cacheformats[k], &q, &c);
+      v2 = (unsigned long long)q;
+    }
+    if (v2 != v1 || c != (i & 0xf))
+      fails++;
+  }
+  return (void *)fails;
+}
+
+static void
+testbitcache(void *data)
+{
+  bitcachestats st;
+  uint8_t buf[8];
+  char format[16];
+  unsigned char c1, c2;
+  pthread_t threads[4];
+  void *ret;
+  size_t i, lookups;
+  bool ok = true;
+
+  bitcachesize(2);
+  bitcacheclear();
+
+  /* a literal is compiled once */
+  for (i = 0; i < 10; i++)
+    bitsprintf(buf, 0, "%C:4 %C:4", 0xa, 0x5);
+  bitcachestat(&st);
+  if (st.misses != 1 || st.hits != 9 || st.size != 1 || st.capa != 2) {
+    testassert(false, "literal is not cached");
+    goto done;
+  }
+
+  /* same contents at another pointer hit the shared table */
+  strcpy(format, "%C:4 %C:4");
+  bitsscanf(buf, 0, format, &c1, &c2);
+  bitcachestat(&st);
+  if (st.misses != 1 || st.hits != 10 || c1 != 0xa || c2 != 0x5) {
+    testassert(false, "contents are not cached");
+    goto done;
+  }
+
+  /* a reused pointer must not run the old program */
+  strcpy(format, "%C:2 %C:6");
+  bitsscanf(buf, 0, format, &c1, &c2);
+  if (c1 != 0x2 || c2 != 0x25) {
+    testassert(false, "stale program for reused pointer");
+    goto done;
+  }
+
+  /* the least recently used is evicted */
+  bitsprintf(buf, 0, "%C", 0);
+  bitcachestat(&st);
+  if (st.size != 2 || st.evictions != 1) {
+    testassert(false, "wrong eviction");
+    goto done;
+  }
+  bitsscanf(buf, 0, "%C:4 %C:4", &c1, &c2);
+  if (c1 != 0x0 || c2 != 0x0) {
+    testassert(false, "wrong program after eviction");
+    goto done;
+  }
+
+  /* threads share a cache smaller than their formats */
+  bitcachestat(&st);
+  lookups = st.hits + st.misses;
+  for (i = 0; i < 4; i++)
+    pthread_create(&threads[i], NULL, cachethread, NULL);
+  for (i = 0; i < 4; i++) {
+    pthread_join(threads[i], &ret);
+    if (ret != NULL)
+      ok = false;
+  }
+  if (!ok) {
+    testassert(false, "wrong values in threads");
+    goto done;
+  }
+
+  /* the hits of the threads are counted when they exit */
+  bitcachestat(&st);
+  if (st.hits + st.misses - lookups != 4 * 40000) {
+    testassert(false, "hits of threads are lost");
+    goto done;
+  }
+
+  bitcachesize(0);
+  bitsprintf(buf, 0, "%C:4 %C:4", 0x1, 0x2);
+  bitcachestat(&st);
+  if (st.size != 0 || buf[0] != 0x12) {
+    testassert(false, "disabled cache keeps programs");
+    goto done;
+  }
+  testassert(true, NULL);
+
+done:
+  bitcachesize(256);
+}
+
+struct streamdata {
+  size_t nrecs;
+  size_t bufsize;
+  size_t skip;
+};
+
+static void **
+datatestbitfscanf()
+{
+  struct streamdata **data;
+  static size_t n = 200;
+  size_t i;
+
+  data = (struct streamdata **)malloc(sizeof(struct streamdata *) * (n+1));
+  data[n] = NULL;
+
+  for (i = 0; i < n; i++) {
+    data[i] = (struct streamdata *)malloc(sizeof(struct streamdata));
+    data[i]->nrecs = (size_t)(abs(rand()) % 500) + 1;
+    data[i]->bufsize = (size_t)(abs(rand()) % 64) + 1;
+    data[i]->skip = (size_t)(abs(rand()) % 200);
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitfscanf(void *data)
+{
+  /* do nothing */
+}
+
+/* records of 70 bits, not aligned to bytes */
+#define STREAMFORMAT    "%C:5 %S<@+ 'z'%C %Q:41 %#:?"
+
+static void
+testbitfscanf(void *data)
+{
+  struct streamdata *test;
+  uint8_t *buf;
+  FILE *fp;
+  bitreader *r;
+  size_t i, size, pos;
+  unsigned char c1, c2;
+  unsigned short s1, s2;
+  unsigned long long q1, q2;
+  char format[64];
+  bool ok = true;
+
+  test = data;
+  size = (test->nrecs * (70 + test->skip) + 7) / 8;
+  buf = (uint8_t *)calloc(size, 1);
+  for (i = 0, pos = 0; i < test->nrecs; i++)
+    pos += bitsprintf(buf, pos, STREAMFORMAT, (int)random(), (int)random(),
+        (unsigned long long)random() << 20 ^ random(), test->skip);
+
+  if ((fp = tmpfile()) == NULL) {
+    testfail("no temporary file");
+    free(buf);
+    return;
+  }
+  fwrite(buf, 1, size, fp);
+
+  /* the cursor moves bit by bit across refills */
+  rewind(fp);
+  r = bitreaderopen(fp, test->bufsize);
+  for (i = 0, pos = 0; i < test->nrecs && ok; i++) {
+    if (bitrscanf(r, STREAMFORMAT, &c1, &s1, &q1, test->skip) != 3 ||
+        bitsscanf(buf, pos, STREAMFORMAT, &c2, &s2, &q2, test->skip) != 3 ||
+        c1 != c2 || s1 != s2 || q1 != q2 ||
+        bitreadertell(r) != (pos += 70 + test->skip))
+      ok = false;
+  }
+  if (ok && bitrscanf(r, "%C:8@?", (size_t)(size * 8 - pos), &c1) != 0)
+    ok = false;
+  bitreaderclose(r);
+  if (!ok) {
+    testassert(false, "wrong values from the reader");
+    goto done;
+  }
+
+  /* files are read a record of whole bytes at a time */
+  rewind(fp);
+  for (i = 0, pos = 0; i < size / 3 && ok; i++, pos += 24) {
+    if (bitfscanf(fp, "%C:4 %S>:12 %#:8", &c1, &s1) != 2 ||
+        bitsscanf(buf, pos, "%C:4 %S>:12", &c2, &s2) != 2 ||
+        c1 != c2 || s1 != s2 || ftell(fp) != (long)((pos + 24) / 8))
+      ok = false;
+  }
+  if (!ok) {
+    testassert(false, "wrong values from the file");
+    goto done;
+  }
+
+  /* a literal of an ignored field beyond the buffer is still checked */
+  pos = size * 8 - 8;
+  bitsscanf(buf, pos, "%C:8", &c2);
+  for (i = 0; i < 2 && ok; i++) {
+    snprintf(format, sizeof(format), "%u%%#@%zu:8 %%C@%zu:8",
+        (unsigned)(c2 ^ i), pos, pos);
+    rewind(fp);
+    r = bitreaderopen(fp, test->bufsize);
+    if (bitrscanf(r, format, &c1) != (i == 0 ? 1 : 0) ||
+        (i == 0 && c1 != c2))
+      ok = false;
+    bitreaderclose(r);
+  }
+  testassert(ok, "wrong literal beyond the buffer");
+
+done:
+  fclose(fp);
+  free(buf);
+}
+
+static void **
+datatestbitfprintf()
+{
+  return datatestbitfscanf();
+}
+
+static void
+freetestbitfprintf(void *data)
+{
+  /* do nothing */
+}
+
+static void
+testbitfprintf(void *data)
+{
+  struct streamdata *test;
+  uint8_t *buf, *out;
+  char *str;
+  FILE *fp;
+  bitwriter *w;
+  size_t i, size, pos, n, len;
+  int c, s;
+  unsigned long long q;
+
+  test = data;
+  len = test->skip / 8 * 8;
+  size = (test->nrecs * (70 + test->skip + len) + 7) / 8;
+  buf = (uint8_t *)calloc(size, 1);
+  out = (uint8_t *)malloc(size);
+  str = (char *)malloc(len / 8 + 1);
+  memset(str, 'x', len / 8);
+  str[len / 8] = '\0';
+
+  if ((fp = tmpfile()) == NULL) {
+    testfail("no temporary file");
+    goto done;
+  }
+
+  /* records are not aligned to bytes, and some have long strings */
+  w = bitwriteropen(fileno(fp), test->bufsize);
+  for (i = 0, pos = 0; i < test->nrecs; i++) {
+    c = (int)random();
+    s = (int)random();
+    q = (unsigned long long)random() << 20 ^ random();
+    if (i % 2 == 0) {
+      n = bitwprintf(w, STREAMFORMAT, c, s, q, test->skip);
+      bitsprintf(buf, pos, STREAMFORMAT, c, s, q, test->skip);
+    } else {
+      n = bitwprintf(w, "%#:? %A:?", 8 - pos % 8, len, str);
+      bitsprintf(buf, pos, "%#:? %A:?", 8 - pos % 8, len, str);
+    }
+    pos += n;
+    if (bitwritertell(w) != pos) {
+      testassert(false, "wrong cursor of the writer");
+      bitwriterclose(w);
+      goto done;
+    }
+    if (i % 50 == 0)
+      bitwriterflush(w);
+  }
+  if (!bitwriterclose(w)) {
+    testassert(false, "writer failed");
+    goto done;
+  }
+
+  size = (pos + 7) / 8;
+  rewind(fp);
+  if (fread(out, 1, size + 1, fp) != size || memcmp(out, buf, size) != 0) {
+    testassert(false, "wrong bytes from the writer");
+    goto done;
+  }
+
+  /* files are written a record of whole bytes at a time */
+  rewind(fp);
+  for (i = 0; i < 10; i++)
+    bitfprintf(fp, "%C:4 %S>:12 %C:3", (int)i, (int)(i * 3), (int)i);
+  fflush(fp);
+  rewind(fp);
+  for (i = 0; i < 10; i++) {
+    if (fread(out, 1, 3, fp) != 3 || out[0] != (i << 4 | (i * 3) >> 8) ||
+        out[1] != ((i * 3) & 0xff) || out[2] != (i & 7) << 5) {
+      testassert(false, "wrong bytes from the file");
+      goto done;
+    }
+  }
+  testassert(true, NULL);
+
+done:
+  if (fp != NULL)
+    fclose(fp);
+  free(buf);
+  free(out);
+  free(str);
+}
+
+void
+inittestbitscanf()
+{
+  TESTADD(testbitsprintf);
+  TESTADD(testbitsscanf);
+  TESTADD(testbitcache);
+  TESTADD(testbitfscanf);
+  TESTADD(testbitfprintf);
+}
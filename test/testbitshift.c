@@ -90,6 +90,12 @@ testbitlshift(void *data)
   testassert(biteq(buf, 0, test->expected, 0, test->capa * 8),
       "failed to write bits to a same buffer");
 
+  /* in place */
+  memcpy(buf, test->bytes, test->capa);
+  bitlshift(buf, test->pos, buf, test->pos, test->size, test->shift);
+  testassert(biteq(buf, test->pos, test->expected, test->expos, test->size),
+      "failed to shift bits in place");
+
   free(buf);
 }
 
@@ -167,6 +173,12 @@ testbitrshift(void *data)
   testassert(biteq(buf, 0, test->expected, 0, test->capa * 8),
       "failed to write bits to a same buffer");
 
+  /* in place */
+  memcpy(buf, test->bytes, test->capa);
+  bitrshift(buf, test->pos, buf, test->pos, test->size, test->shift);
+  testassert(biteq(buf, test->pos, test->expected, test->expos, test->size),
+      "failed to shift bits in place");
+
   free(buf);
 }
 
@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitscan.h"
+#include "test.h"
+#include "testgen.h"
+
+#define FORMAT \
+  "%C:5 %s<:16 'x'%C %I>:23 %Q@70:61 %d< %A:20 -3%i:7 %L<:40 %f@256"
+#define LAYOUTSIZE  288
+
+struct testdata {
+  size_t pos;
+  bool flag;
+};
+
+static void **
+datatestbitview()
+{
+  struct testdata **data;
+  static size_t n = 10000;
+  size_t i;
+
+  data = (struct testdata **)malloc(sizeof(struct testdata *) * (n+1));
+  data[n] = NULL;
+
+  for (i = 0; i < n; i++) {
+    data[i] = (struct testdata *)malloc(sizeof(struct testdata));
+    data[i]->pos = (size_t)(abs(rand()) % 256);
+    data[i]->flag = (bool)(abs(random() % 2));
+  }
+
+  return (void **)data;
+}
+
+static void
+freetestbitview(void *data)
+{
+  /* do nothing */
+}
+
+static uint64_t
+gen64()
+{
+  return (uint64_t)random() << 33 ^ (uint64_t)random() << 11 ^
+    (uint64_t)random();
+}
+
+static void
+testbitview(void *data)
+{
+  static bitlayout *layout = NULL;
+  struct testdata *test;
+  uint8_t buf[80];
+  bitview view;
+  unsigned char c;
+  short s;
+  unsigned int u;
+  unsigned long long q;
+  double d;
+  char a[4], str[3];
+  unsigned long l;
+  float f;
+
+  if (layout == NULL)
+    layout = bitlayoutf(FORMAT);
+  if (layout == NULL || bitlayoutsize(layout) != LAYOUTSIZE ||
+      bitlayoutcount(layout) != 10) {
+    testassert(false, "wrong layout");
+    return;
+  }
+
+  test = data;
+  memset(buf, test->flag ? 0xff : 0, sizeof(buf));
+  a[0] = 'a' + random() % 26;
+  a[1] = 'a' + random() % 26;
+  a[2] = 'a' + random() % 26;
+  a[3] = '\0';
+  bitsprintf(buf, test->pos, FORMAT, (int)random(), (int)random(),
+      (unsigned int)gen64(), (unsigned long long)gen64(),
+      (double)random() / 64, a, (unsigned long)gen64(),
+      (double)random() / 4);
+  bitsscanf(buf, test->pos, FORMAT, &c, &s, &u, &q, &d, str, &l, &f);
+
+  /* views are copied by value */
+  view = bitviewmake(layout, buf, test->pos);
+  if (bitviewget(view, 0) != c || (short)bitviewget(view, 1) != s ||
+      bitviewget(view, 2) != 'x' || bitviewget(view, 3) != u ||
+      bitviewget(view, 4) != q || bitviewgetf(view, 5) != d ||
+      (int)bitviewget(view, 7) != -3 || bitviewget(view, 8) != l ||
+      (float)bitviewgetf(view, 9) != f || bitviewget(view, 10) != 0) {
+    testassert(false, "wrong field values");
+    return;
+  }
+
+  memset(a, 0, sizeof(a));
+  if (bitviewcopy(view, 6, a) != 20 || !biteq(a, 0, str, 0, 20)) {
+    testassert(false, "wrong copied field");
+    return;
+  }
+
+  if (!bitviewvalid(view)) {
+    testassert(false, "literals do not match");
+    return;
+  }
+  bitset(buf, test->pos + 25, !bitget(buf, test->pos + 25));
+  if (bitviewvalid(view)) {
+    testassert(false, "wrong literal matches");
+    return;
+  }
+
+  testassert(true, NULL);
+}
+
+void
+inittestbitview()
+{
+  TESTADD(testbitview);
+}